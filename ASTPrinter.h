@@ -5,132 +5,287 @@
 #ifndef LOX_ASTPRINTER_H
 #define LOX_ASTPRINTER_H
 
+#include <charconv>
+#include <ostream>
+#include <sstream>
 #include <type_traits>
+#include <variant>
+#include <vector>
 
 #include "Expr.h"
 #include "Lox.h"
+#include "Statement.h"
 
 namespace Lox {
 
-struct ASTPrinter : public Expr::Visitor {
-  std::string result;
+// Prints an expression tree, or a program's statements, as s-expressions.
+//
+// The tree is walked with an explicit work stack instead of recursing through
+// accept(), so arbitrarily deep trees cannot overflow the C++ stack. Each
+// visit writes the node's prefix straight to the output stream and pushes the
+// remaining pieces (children and closing text) in reverse order; nothing is
+// accumulated in an intermediate string.
+struct ASTPrinter : public Expr::Visitor, public Statement::Visitor {
+  void print(const Expr *expr, std::ostream &os) {
+    out = &os;
+    stack.clear();
+    stack.emplace_back(expr);
+    drain();
+    out = nullptr;
+  }
+
+  // Prints each statement on a line of its own.
+  void print(const std::vector<std::shared_ptr<Statement>> &statements,
+             std::ostream &os) {
+    out = &os;
+    stack.clear();
+    for (auto statement = statements.rbegin(); statement != statements.rend();
+         ++statement) {
+      push("\n");
+      push(statement->get());
+    }
+    drain();
+    out = nullptr;
+  }
+
   std::string print(Expr *expr) {
-    expr->accept(*this);
-    return result;
+    std::ostringstream os;
+    print(expr, os);
+    return os.str();
   }
 
   std::any visitAssign(const Assign &expr) override {
-    result += "(= " + expr.name.getLexeme() + " ";
-    expr.value->accept(*this);
-    result += ")";
+    *out << "(= " << expr.name.getLexeme() << " ";
+    push(")");
+    push(expr.value.get());
     return {};
   }
 
   std::any visitBinary(const Binary &expr) override {
-    result += "(" + expr.op.getLexeme() + " ";
-    expr.left->accept(*this);
-    result += " ";
-    expr.right->accept(*this);
-    result += ")";
+    *out << "(" << expr.op.getLexeme() << " ";
+    push(")");
+    push(expr.right.get());
+    push(" ");
+    push(expr.left.get());
     return {};
   }
 
   std::any visitCall(const Call &expr) override {
-    result += "(call ";
-    expr.callee->accept(*this);
-    for (const auto &arg : expr.arguments) {
-      result += " ";
-      arg->accept(*this);
+    *out << "(call ";
+    push(")");
+    for (auto arg = expr.arguments.rbegin(); arg != expr.arguments.rend();
+         ++arg) {
+      push(arg->get());
+      push(" ");
     }
-    result += ")";
-
+    push(expr.callee.get());
     return {};
   }
 
   std::any visitGet(const Get &expr) override {
-    result += "(get ";
-    expr.object->accept(*this);
-    result += "." + expr.name.getLexeme() + ")";
-
+    *out << "(get ";
+    push(")");
+    push(&expr.name);
+    push(".");
+    push(expr.object.get());
     return {};
   }
 
   std::any visitGrouping(const Grouping &expr) override {
-    result += "(group ";
-    expr.expression->accept(*this);
-    result += ")";
-
+    *out << "(group ";
+    push(")");
+    push(expr.expression.get());
     return {};
   }
 
   std::any visitLiteral(const Literal &expr) override {
+    *out << "(literal ";
     std::visit(
         [&](const auto &value) {
-          if constexpr (std::is_same_v<std::string,
-                                       std::decay_t<decltype(value)>>) {
-            result += "(literal " + value + ")";
-            return;
+          using T = std::decay_t<decltype(value)>;
+          if constexpr (std::is_same_v<T, std::string>) {
+            *out << value;
+          } else if constexpr (std::is_same_v<T, bool>) {
+            *out << (value ? "true" : "false");
+          } else if constexpr (std::is_same_v<T, double>) {
+            char buffer[32];
+            auto [end, ec] =
+                std::to_chars(buffer, buffer + sizeof(buffer), value);
+            out->write(buffer, end - buffer);
+          } else {
+            *out << "nil";
           }
-          if constexpr (std::is_same_v<bool, std::decay_t<decltype(value)>> ||
-                        std::is_same_v<double, std::decay_t<decltype(value)>>) {
-            result += "(literal " + std::to_string(value) + ")";
-            return;
-          }
-
-          Lox::error(1, "Unknown literal type");
         },
         expr.value);
-
+    *out << ")";
     return {};
   }
 
   std::any visitLogical(const Logical &expr) override {
-    result += "(" + expr.op.getLexeme() + " ";
-    expr.left->accept(*this);
-    result += " ";
-    expr.right->accept(*this);
-    result += ")";
-
+    *out << "(" << expr.op.getLexeme() << " ";
+    push(")");
+    push(expr.right.get());
+    push(" ");
+    push(expr.left.get());
     return {};
   }
 
   std::any visitSet(const Set &expr) override {
-    result += "(set ";
-    expr.object->accept(*this);
-    result += "." + expr.name.getLexeme() + " ";
-    expr.value->accept(*this);
-    result += ")";
-
+    *out << "(set ";
+    push(")");
+    push(expr.value.get());
+    push(" ");
+    push(&expr.name);
+    push(".");
+    push(expr.object.get());
     return {};
   }
 
   std::any visitSuper(const Super &expr) override {
-    result += "(super " + expr.method.getLexeme() + ")";
-
+    *out << "(super " << expr.method.getLexeme() << ")";
     return {};
   }
 
   std::any visitThis(const This &expr) override {
-    result += "(this)";
+    *out << "(this)";
     return {};
   }
 
   std::any visitUnary(const Unary &expr) override {
-    result += "(u" + expr.op.getLexeme() + " ";
-    expr.right->accept(*this);
-    result += ")";
-
+    *out << "(u" << expr.op.getLexeme() << " ";
+    push(")");
+    push(expr.right.get());
     return {};
   }
 
   std::any visitVariable(const Variable &expr) override {
-    result += "(var " + expr.name.getLexeme() + ")";
+    *out << "(var " << expr.name.getLexeme() << ")";
+    return {};
+  }
+
+  std::any visitBlock(const Block &stmt) override {
+    *out << "(block";
+    push(")");
+    pushAll(stmt.statements);
+    return {};
+  }
+
+  std::any visitClass(const Class &stmt) override {
+    *out << "(class " << stmt.name.getLexeme();
+    if (stmt.superclass)
+      *out << " < " << stmt.superclass->name.getLexeme();
+    push(")");
+    for (auto method = stmt.methods.rbegin(); method != stmt.methods.rend();
+         ++method) {
+      push(method->get());
+      push(" ");
+    }
+    return {};
+  }
+
+  std::any visitExpression(const Expression &stmt) override {
+    *out << "(; ";
+    push(")");
+    push(stmt.expression.get());
+    return {};
+  }
 
+  std::any visitFunction(const Function &stmt) override {
+    *out << "(fun " << stmt.name.getLexeme() << " (";
+    for (size_t i = 0; i < stmt.params.size(); ++i)
+      *out << (i ? " " : "") << stmt.params[i].getLexeme();
+    *out << ")";
+    push(")");
+    pushAll(stmt.body);
     return {};
   }
+
+  std::any visitIf(const If &stmt) override {
+    *out << "(if ";
+    push(")");
+    if (stmt.elseBranch) {
+      push(stmt.elseBranch.get());
+      push(" ");
+    }
+    push(stmt.thenBranch.get());
+    push(" ");
+    push(stmt.condition.get());
+    return {};
+  }
+
+  std::any visitPrint(const Print &stmt) override {
+    *out << "(print ";
+    push(")");
+    push(stmt.expression.get());
+    return {};
+  }
+
+  std::any visitReturn(const Return &stmt) override {
+    *out << "(return";
+    push(")");
+    if (stmt.value) {
+      push(stmt.value.get());
+      push(" ");
+    }
+    return {};
+  }
+
+  std::any visitVar(const Var &stmt) override {
+    *out << "(define " << stmt.name.getLexeme();
+    push(")");
+    if (stmt.initializer) {
+      push(stmt.initializer.get());
+      push(" ");
+    }
+    return {};
+  }
+
+  std::any visitWhile(const While &stmt) override {
+    *out << "(while ";
+    push(")");
+    push(stmt.body.get());
+    push(" ");
+    push(stmt.condition.get());
+    return {};
+  }
+
+private:
+  // A pending piece of output: a subtree, a statement, a fixed string, or a
+  // token lexeme.
+  using Work =
+      std::variant<const Expr *, Statement *, const char *, const Token *>;
+
+  std::vector<Work> stack;
+  std::ostream *out = nullptr;
+
+  void push(Work work) { stack.push_back(work); }
+
+  // Pushes `statements` to be printed in order, each after a space.
+  void pushAll(const std::vector<std::shared_ptr<Statement>> &statements) {
+    for (auto statement = statements.rbegin(); statement != statements.rend();
+         ++statement) {
+      push(statement->get());
+      push(" ");
+    }
+  }
+
+  void drain() {
+    while (!stack.empty()) {
+      auto work = stack.back();
+      stack.pop_back();
+      if (auto node = std::get_if<const Expr *>(&work)) {
+        (*node)->accept(*this);
+      } else if (auto statement = std::get_if<Statement *>(&work)) {
+        (*statement)->accept(*this);
+      } else if (auto text = std::get_if<const char *>(&work)) {
+        *out << *text;
+      } else {
+        *out << std::get<const Token *>(work)->getLexeme();
+      }
+    }
+  }
 };
 
-}; // namespace Lox
-;  // namespace Lox
+} // namespace Lox
 
 #endif // LOX_ASTPRINTER_H
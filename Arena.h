@@ -0,0 +1,81 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+#ifndef LOX_ARENA_H
+#define LOX_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "Value.h"
+
+namespace Lox {
+
+// A bump allocator for the slots of nested scopes.
+//
+// Storage is handed out in stack order and given back in bulk: a Scope
+// records the allocation point when a block or call is entered and rewinds
+// to it when that block or call exits, however it exits. Chunks are kept
+// and reused, so a program whose scopes nest no deeper than before makes no
+// further calls to malloc. Anything that must outlive its scope has to be
+// copied out before the scope ends.
+class Arena {
+  static constexpr std::size_t chunkSize = 4096;
+
+  struct Chunk {
+    std::unique_ptr<Value[]> values;
+    std::size_t capacity;
+  };
+
+  std::vector<Chunk> chunks;
+  // The chunk being bumped and the number of values used in it.
+  std::size_t chunk = 0;
+  std::size_t used = 0;
+
+  // Moves on to a chunk with room for `count` values, creating it after the
+  // current one if the next chunk is missing or too small.
+  void advance(std::size_t count) {
+    std::size_t next = chunks.empty() ? 0 : chunk + 1;
+    if (next == chunks.size() || chunks[next].capacity < count) {
+      auto capacity = std::max(count, chunkSize);
+      chunks.insert(chunks.begin() + static_cast<std::ptrdiff_t>(next),
+                    {std::make_unique<Value[]>(capacity), capacity});
+    }
+    chunk = next;
+    used = 0;
+  }
+
+public:
+  class Scope {
+    Arena &arena;
+    std::size_t chunk;
+    std::size_t used;
+
+  public:
+    explicit Scope(Arena &arena)
+        : arena(arena), chunk(arena.chunk), used(arena.used) {}
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+    ~Scope() {
+      arena.chunk = chunk;
+      arena.used = used;
+    }
+  };
+
+  // `count` nil values, valid until the innermost live Scope ends.
+  std::span<Value> allocate(std::size_t count) {
+    if (chunks.empty() || used + count > chunks[chunk].capacity)
+      advance(count);
+    std::span<Value> values(chunks[chunk].values.get() + used, count);
+    used += count;
+    std::fill(values.begin(), values.end(), Value::nil());
+    return values;
+  }
+};
+} // namespace Lox
+
+#endif // LOX_ARENA_H
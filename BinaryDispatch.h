@@ -0,0 +1,182 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+#ifndef LOX_BINARYDISPATCH_H
+#define LOX_BINARYDISPATCH_H
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+
+#include "TokeyType.h"
+#include "Value.h"
+
+namespace Lox {
+using BinaryHandler = Value (*)(Value left, Value right, Heap &heap);
+
+namespace detail {
+inline constexpr std::size_t tokenTypeCount =
+    static_cast<std::size_t>(TokenType::EoF) + 1;
+
+constexpr bool isArithmetic(TokenType op) {
+  return op == TokenType::MINUS || op == TokenType::SLASH ||
+         op == TokenType::STAR;
+}
+
+constexpr bool isComparison(TokenType op) {
+  return op == TokenType::GREATER || op == TokenType::GREATER_EQUAL ||
+         op == TokenType::LESS || op == TokenType::LESS_EQUAL;
+}
+
+template <TokenType Op> constexpr const char *operandErrorMessage() {
+  if constexpr (isArithmetic(Op) || isComparison(Op))
+    return "Operands must be numbers";
+  else if constexpr (Op == TokenType::PLUS)
+    return "Operands must be two numbers or two strings";
+  else
+    return "Unknown binary operator";
+}
+
+// Error cells: every operand combination an operator does not accept.
+template <TokenType Op>
+[[noreturn, gnu::cold, gnu::noinline]] Value operandError(Value, Value,
+                                                          Heap &) {
+  throw std::runtime_error(operandErrorMessage<Op>());
+}
+
+template <TokenType Op> Value numeric(Value left, Value right, Heap &) {
+  double a = left.asNumber();
+  double b = right.asNumber();
+  if constexpr (Op == TokenType::MINUS)
+    return Value::number(a - b);
+  else if constexpr (Op == TokenType::SLASH)
+    return Value::number(a / b);
+  else if constexpr (Op == TokenType::STAR)
+    return Value::number(a * b);
+  else if constexpr (Op == TokenType::PLUS)
+    return Value::number(a + b);
+  else if constexpr (Op == TokenType::GREATER)
+    return Value::boolean(a > b);
+  else if constexpr (Op == TokenType::GREATER_EQUAL)
+    return Value::boolean(a >= b);
+  else if constexpr (Op == TokenType::LESS)
+    return Value::boolean(a < b);
+  else
+    return Value::boolean(a <= b);
+}
+
+inline Value concatenate(Value left, Value right, Heap &heap) {
+  return heap.concatenate(left.asString(), right.asString());
+}
+
+template <ValueTag Tag> bool sameTypeEqual(Value left, Value right) {
+  if constexpr (Tag == ValueTag::Number)
+    return left.asNumber() == right.asNumber();
+  else if constexpr (Tag == ValueTag::String)
+    return left.asString()->equals(right.asString());
+  else if constexpr (Tag == ValueTag::Bool)
+    return left.asBool() == right.asBool();
+  else if constexpr (Tag == ValueTag::Nil)
+    return true;
+  else
+    return left.asObject() == right.asObject();
+}
+
+template <TokenType Op, ValueTag L, ValueTag R>
+Value equality(Value left, Value right, Heap &) {
+  constexpr bool equalIfSameType = Op == TokenType::EQUAL_EQUAL;
+  if constexpr (L != R)
+    return Value::boolean(!equalIfSameType);
+  else
+    return Value::boolean(sameTypeEqual<L>(left, right) == equalIfSameType);
+}
+
+// Whether an operator accepts operands of types L and R.
+template <TokenType Op, ValueTag L, ValueTag R> constexpr bool accepts() {
+  constexpr bool numbers = L == ValueTag::Number && R == ValueTag::Number;
+  constexpr bool strings = L == ValueTag::String && R == ValueTag::String;
+  if constexpr (Op == TokenType::EQUAL_EQUAL || Op == TokenType::BANG_EQUAL)
+    return true;
+  else if constexpr (isArithmetic(Op) || isComparison(Op))
+    return numbers;
+  else if constexpr (Op == TokenType::PLUS)
+    return numbers || strings;
+  else
+    return false;
+}
+
+// Picks the handler for one (operator, left type, right type) cell.
+template <TokenType Op, ValueTag L, ValueTag R>
+constexpr BinaryHandler cell() {
+  if constexpr (!accepts<Op, L, R>())
+    return &operandError<Op>;
+  else if constexpr (Op == TokenType::EQUAL_EQUAL ||
+                     Op == TokenType::BANG_EQUAL)
+    return &equality<Op, L, R>;
+  else if constexpr (L == ValueTag::String)
+    return &concatenate;
+  else
+    return &numeric<Op>;
+}
+
+template <TokenType Op, ValueTag L, ValueTag R>
+constexpr const char *cellError() {
+  if constexpr (accepts<Op, L, R>())
+    return nullptr;
+  else
+    return operandErrorMessage<Op>();
+}
+
+template <std::size_t... I>
+constexpr auto makeBinaryTable(std::index_sequence<I...>) {
+  constexpr std::size_t tags = valueTagCount;
+  return std::array<BinaryHandler, sizeof...(I)>{
+      cell<static_cast<TokenType>(I / (tags * tags)),
+           static_cast<ValueTag>(I / tags % tags),
+           static_cast<ValueTag>(I % tags)>()...};
+}
+
+template <std::size_t... I>
+constexpr auto makeBinaryErrorTable(std::index_sequence<I...>) {
+  constexpr std::size_t tags = valueTagCount;
+  return std::array<const char *, sizeof...(I)>{
+      cellError<static_cast<TokenType>(I / (tags * tags)),
+                static_cast<ValueTag>(I / tags % tags),
+                static_cast<ValueTag>(I % tags)>()...};
+}
+
+inline constexpr std::size_t binaryTableSize =
+    tokenTypeCount * valueTagCount * valueTagCount;
+
+inline std::size_t binaryIndex(TokenType op, Value left, Value right) {
+  return (static_cast<std::size_t>(op) * valueTagCount +
+          static_cast<std::size_t>(left.tag())) *
+             valueTagCount +
+         static_cast<std::size_t>(right.tag());
+}
+} // namespace detail
+
+// Handlers for every (operator, left type, right type) combination, indexed
+// directly by TokenType so evaluation needs no switch on the operator.
+// Combinations an operator does not accept resolve to cold error handlers;
+// this is the one place to give mixed-type operands new semantics.
+inline constexpr auto binaryTable = detail::makeBinaryTable(
+    std::make_index_sequence<detail::binaryTableSize>{});
+
+// The message each error cell of binaryTable throws, and null for every
+// other cell, so callers can report the error without an exception.
+inline constexpr auto binaryErrorTable = detail::makeBinaryErrorTable(
+    std::make_index_sequence<detail::binaryTableSize>{});
+
+inline BinaryHandler binaryHandler(TokenType op, Value left, Value right) {
+  return binaryTable[detail::binaryIndex(op, left, right)];
+}
+
+inline const char *binaryError(TokenType op, Value left, Value right) {
+  return binaryErrorTable[detail::binaryIndex(op, left, right)];
+}
+} // namespace Lox
+
+#endif // LOX_BINARYDISPATCH_H
@@ -0,0 +1,110 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+#include <iomanip>
+
+#include "Chunk.h"
+#include "Statement.h"
+
+namespace Lox {
+static const char *opcodeName(OpCode op) {
+  switch (op) {
+#define LOX_OPCODE_NAME(name)                                                  \
+  case OpCode::name:                                                           \
+    return #name;
+    LOX_OPCODES(LOX_OPCODE_NAME)
+#undef LOX_OPCODE_NAME
+  }
+  return "Unknown";
+}
+
+void disassemble(const Chunk &chunk, std::ostream &out) {
+  std::size_t offset = 0;
+  while (offset < chunk.code.size()) {
+    auto op = static_cast<OpCode>(chunk.code[offset]);
+    out << std::setw(4) << std::setfill('0') << offset << std::setfill(' ')
+        << " " << std::setw(4) << chunk.lines[offset] << " "
+        << opcodeName(op);
+    switch (op) {
+    case OpCode::Constant: {
+      auto index = chunk.readShort(offset + 1);
+      out << " " << index << " '" << to_string(chunk.constants[index]) << "'";
+      offset += 3;
+      break;
+    }
+    case OpCode::Get:
+    case OpCode::Set:
+      out << " '" << chunk.names[chunk.readShort(offset + 1)] << "'";
+      offset += 3;
+      break;
+    case OpCode::Super:
+      out << " '" << chunk.names[chunk.readShort(offset + 1)] << "' "
+          << chunk.readShort(offset + 3);
+      offset += 5;
+      break;
+    case OpCode::Closure: {
+      auto function = chunk.functions[chunk.readShort(offset + 1)];
+      out << " <fn " << function->declaration->name.getLexeme() << ">";
+      offset += 3;
+      break;
+    }
+    case OpCode::Class: {
+      const auto &code = chunk.classes[chunk.readShort(offset + 1)];
+      out << " " << code.declaration->name.getLexeme();
+      offset += 3;
+      break;
+    }
+    case OpCode::GetLocal:
+    case OpCode::SetLocal:
+    case OpCode::GetGlobal:
+    case OpCode::SetGlobal:
+    case OpCode::DefineGlobal:
+    case OpCode::Reserve:
+    case OpCode::Release:
+    case OpCode::PushEnv:
+    case OpCode::Check:
+    case OpCode::CheckCall:
+    case OpCode::TailCall:
+      out << " " << chunk.readShort(offset + 1);
+      offset += 3;
+      break;
+    case OpCode::GetEnv:
+    case OpCode::SetEnv:
+    case OpCode::Call:
+      out << " " << chunk.readShort(offset + 1) << " "
+          << chunk.readShort(offset + 3);
+      offset += 5;
+      break;
+    case OpCode::Jump:
+    case OpCode::JumpIfFalse:
+    case OpCode::And:
+    case OpCode::Or:
+      out << " -> " << offset + 3 + chunk.readShort(offset + 1);
+      offset += 3;
+      break;
+    case OpCode::Loop:
+      out << " -> " << offset + 3 - chunk.readShort(offset + 1);
+      offset += 3;
+      break;
+    default:
+      offset += 1;
+      break;
+    }
+    out << "\n";
+  }
+
+  // Then the bodies of the functions and methods declared in the chunk.
+  for (auto function : chunk.functions) {
+    out << "== " << function->declaration->name.getLexeme() << " ==\n";
+    disassemble(*function, out);
+  }
+  for (const auto &code : chunk.classes) {
+    for (auto method : code.methods) {
+      out << "== " << code.declaration->name.getLexeme() << "."
+          << method->declaration->name.getLexeme() << " ==\n";
+      disassemble(*method, out);
+    }
+  }
+}
+} // namespace Lox
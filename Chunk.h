@@ -0,0 +1,137 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+#ifndef LOX_CHUNK_H
+#define LOX_CHUNK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "InlineCache.h"
+#include "Value.h"
+
+namespace Lox {
+struct Class;
+struct Function;
+
+// Every instruction is one opcode byte followed by zero, one or two 16-bit
+// big-endian operands:
+//
+//   Constant, GetLocal, SetLocal, GetGlobal, SetGlobal, DefineGlobal,
+//   Reserve, Release, PushEnv, Closure, Class, Get, Set, Check, CheckCall
+//   and TailCall take one: a constant, stack slot, global, count, function,
+//   class, property site, expression level or argument count.
+//   GetEnv and SetEnv take a frame depth and a slot, Super a property site
+//   and a frame depth, and Call an argument count and an expression level.
+//   Jump, JumpIfFalse, And and Or take a forward offset, Loop a backward
+//   one.
+#define LOX_OPCODES(X)                                                         \
+  X(Constant)                                                                  \
+  X(Nil)                                                                       \
+  X(True)                                                                      \
+  X(False)                                                                     \
+  X(Pop)                                                                       \
+  X(GetLocal)                                                                  \
+  X(SetLocal)                                                                  \
+  X(GetEnv)                                                                    \
+  X(SetEnv)                                                                    \
+  X(GetGlobal)                                                                 \
+  X(SetGlobal)                                                                 \
+  X(DefineGlobal)                                                              \
+  X(Reserve)                                                                   \
+  X(Release)                                                                   \
+  X(PushEnv)                                                                   \
+  X(PopEnv)                                                                    \
+  X(Get)                                                                       \
+  X(CheckInstance)                                                             \
+  X(Set)                                                                       \
+  X(Super)                                                                     \
+  X(Equal)                                                                     \
+  X(NotEqual)                                                                  \
+  X(Greater)                                                                   \
+  X(GreaterEqual)                                                              \
+  X(Less)                                                                      \
+  X(LessEqual)                                                                 \
+  X(Add)                                                                       \
+  X(Subtract)                                                                  \
+  X(Multiply)                                                                  \
+  X(Divide)                                                                    \
+  X(Not)                                                                       \
+  X(Negate)                                                                    \
+  X(Print)                                                                     \
+  X(Jump)                                                                      \
+  X(JumpIfFalse)                                                               \
+  X(And)                                                                       \
+  X(Or)                                                                        \
+  X(Loop)                                                                      \
+  X(Check)                                                                     \
+  X(CheckCall)                                                                 \
+  X(Call)                                                                      \
+  X(TailCall)                                                                  \
+  X(Closure)                                                                   \
+  X(Class)                                                                     \
+  X(Return)
+
+enum class OpCode : uint8_t {
+#define LOX_OPCODE_ENUM(name) name,
+  LOX_OPCODES(LOX_OPCODE_ENUM)
+#undef LOX_OPCODE_ENUM
+};
+
+struct Chunk;
+
+// The code of a class declaration: the body of each of its methods, in
+// declaration order.
+struct ClassCode {
+  const Class *declaration;
+  std::vector<const Chunk *> methods;
+};
+
+struct Chunk {
+  std::vector<uint8_t> code;
+  std::vector<int> lines;
+  std::vector<Value> constants;
+  // Highest number of values the code keeps on the VM stack at once,
+  // counting the locals of a function but not its callee slot.
+  int maxStack = 0;
+  // The function this is the body of, or null for top-level code.
+  const Function *declaration = nullptr;
+  // The functions and classes declared in this code, by the operand of
+  // Closure and Class.
+  std::vector<const Chunk *> functions;
+  std::vector<ClassCode> classes;
+  // The property name of each Get, Set and Super site, with the inline
+  // cache of the site.
+  std::vector<std::string> names;
+  mutable std::vector<PropertyCache> caches;
+
+  void write(uint8_t byte, int line) {
+    code.push_back(byte);
+    lines.push_back(line);
+  }
+
+  void write(OpCode op, int line) { write(static_cast<uint8_t>(op), line); }
+
+  void writeShort(uint16_t operand, int line) {
+    write(static_cast<uint8_t>(operand >> 8), line);
+    write(static_cast<uint8_t>(operand & 0xff), line);
+  }
+
+  [[nodiscard]] uint16_t readShort(std::size_t offset) const {
+    return static_cast<uint16_t>(code[offset] << 8 | code[offset + 1]);
+  }
+
+  std::size_t addConstant(Value value) {
+    constants.push_back(value);
+    return constants.size() - 1;
+  }
+};
+
+void disassemble(const Chunk &chunk, std::ostream &out);
+} // namespace Lox
+
+#endif // LOX_CHUNK_H
@@ -0,0 +1,5 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+#include "ClosureCompiler.h"
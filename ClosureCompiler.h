@@ -0,0 +1,770 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+#ifndef LOX_CLOSURECOMPILER_H
+#define LOX_CLOSURECOMPILER_H
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Arena.h"
+#include "BinaryDispatch.h"
+#include "Environment.h"
+#include "Expr.h"
+#include "Lox.h"
+#include "Resolver.h"
+#include "Statement.h"
+#include "Value.h"
+
+namespace Lox {
+
+// Compiles the AST once into a tree of callables.
+//
+// Every node becomes a closure specialised for its operator, holding its
+// already-compiled children, so evaluation involves no accept() calls and
+// no switch on the operator. The closures refer to this compiler's heap and
+// must not outlive it. Errors match the Interpreter's messages.
+//
+// Programs run the way the Interpreter runs them: frames are Environments
+// over Arena slots, promoted when a closure captures them, and a statement
+// reports a `return` or tail call through the Completion it returns.
+//
+// The Interpreter fails once an expression nests maxDepth deep, counting
+// from the depth of the call it runs in. Top-level code runs at depth 0,
+// where the Parser has already bounded every expression, but a function
+// body runs at whatever depth it was called from, so there the first node
+// of each new level is wrapped in a check. The wrapper of a node also
+// covers the nodes evaluated first beneath it, since nothing observable
+// happens before them.
+class ClosureCompiler : Expr::Visitor, Statement::Visitor {
+public:
+  // How a statement finished: normally, by `return`, or by a `return` of a
+  // call that is to replace the current one.
+  enum class Completion { Normal, Return, TailCall };
+
+  using ExprClosure = std::function<Value()>;
+  using StmtClosure = std::function<Completion()>;
+
+private:
+  struct Global {
+    Value value;
+    bool defined = false;
+  };
+
+  Heap heap;
+  ExprClosure exprResult;
+  StmtClosure stmtResult;
+  int maxDepth;
+
+  // The compiled body of every function and method declaration.
+  std::unordered_map<const Function *, StmtClosure> bodies;
+  // Whether a function body is being compiled, how deeply the expression
+  // being compiled nests within its statement, the deepest level a check
+  // has verified on every path to it, and the level the check still being
+  // extended to nodes evaluated first will verify.
+  bool function = false;
+  int level = 0;
+  int checked = 0;
+  int *openCheck = nullptr;
+
+  // Runtime state. Globals are never erased, so closures hold on to their
+  // entries.
+  std::unordered_map<std::string, Global> globals;
+  std::shared_ptr<Environment> environment;
+  // Environments of the blocks and calls that are suspended while an inner
+  // one runs.
+  std::vector<std::shared_ptr<Environment>> frames;
+  // Values held only by C++ locals while code that may collect garbage runs.
+  std::vector<Value> temporaries;
+  Arena arena;
+  // The expression depth the running call was made at.
+  int base = 0;
+  // The value of a completed `return`, and the function and arguments of a
+  // tail call, which the enclosing call() runs in place of the current one.
+  Value returnValue;
+  ObjFunction *tailFunction = nullptr;
+  std::vector<Value> tailArguments;
+
+  // Pushes temporaries that stay rooted until the guard goes out of scope.
+  class Temporaries {
+    std::vector<Value> &stack;
+    std::size_t size;
+
+  public:
+    explicit Temporaries(ClosureCompiler &compiler)
+        : stack(compiler.temporaries), size(stack.size()) {}
+    Temporaries(const Temporaries &) = delete;
+    Temporaries &operator=(const Temporaries &) = delete;
+    ~Temporaries() { stack.resize(size); }
+
+    void push(Value value) { stack.push_back(value); }
+  };
+
+  // Evaluates `next` with `held` rooted, if it is an object.
+  Value evaluateHolding(Value held, const ExprClosure &next) {
+    if (!held.isObject())
+      return next();
+    Temporaries roots(*this);
+    roots.push(held);
+    return next();
+  }
+
+  // An arithmetic or comparison operator: numbers are handled inline, other
+  // operands go through the binary dispatch table.
+  template <TokenType Op, typename F>
+  ExprClosure numeric(const Binary &expr, F op) {
+    auto left = compile(expr.left.get());
+    auto right = compile(expr.right.get());
+    return [this, left = std::move(left), right = std::move(right), op]() {
+      Value a = left();
+      Value b = evaluateHolding(a, right);
+      if (a.isNumber() && b.isNumber())
+        return op(a.asNumber(), b.asNumber());
+      return binaryHandler(Op, a, b)(a, b, heap);
+    };
+  }
+
+  template <bool Equal> ExprClosure equality(const Binary &expr) {
+    auto left = compile(expr.left.get());
+    auto right = compile(expr.right.get());
+    return [this, left = std::move(left), right = std::move(right)]() {
+      Value a = left();
+      Value b = evaluateHolding(a, right);
+      return Value::boolean((a == b) == Equal);
+    };
+  }
+
+  // Compiles an expression a statement evaluates.
+  ExprClosure evaluate(const Expr *expr) {
+    level = 0;
+    checked = 0;
+    return compile(expr);
+  }
+
+  StmtClosure
+  sequence(const std::vector<std::shared_ptr<Statement>> &statements) {
+    std::vector<StmtClosure> closures;
+    for (const auto &statement : statements)
+      closures.push_back(compile(statement.get()));
+    return [closures = std::move(closures)]() {
+      for (const auto &closure : closures) {
+        auto completion = closure();
+        if (completion != Completion::Normal)
+          return completion;
+      }
+      return Completion::Normal;
+    };
+  }
+
+  void compileFunction(const Function &declaration) {
+    auto enclosing = std::exchange(function, true);
+    bodies[&declaration] = sequence(declaration.body);
+    function = enclosing;
+  }
+
+  // The global `name`, or null for a variable resolved to a slot.
+  Global *global(const Token &name, int slot) {
+    return slot < 0 ? &globals[name.getLexeme()] : nullptr;
+  }
+
+  // Binds a declaration to its slot, or to `global`.
+  void define(Global *global, int slot, Value value) {
+    if (global != nullptr) {
+      global->value = value;
+      global->defined = true;
+    } else {
+      environment->slots[slot] = value;
+    }
+  }
+
+  ExprClosure load(const Token &name, const Slot &resolved) {
+    if (resolved.depth < 0) {
+      return [global = &globals[name.getLexeme()], name = name.getLexeme()]() {
+        if (!global->defined)
+          throw std::runtime_error("Undefined variable '" + name + "'.");
+        return global->value;
+      };
+    }
+    if (resolved.depth == 0)
+      return [this, slot = resolved.slot]() {
+        return environment->slots[slot];
+      };
+    return [this, resolved]() {
+      return environment->at(resolved.depth, resolved.slot);
+    };
+  }
+
+  ExprClosure store(const Token &name, const Slot &resolved,
+                    ExprClosure value) {
+    if (resolved.depth < 0) {
+      return [global = &globals[name.getLexeme()], name = name.getLexeme(),
+              value = std::move(value)]() {
+        Value result = value();
+        if (!global->defined)
+          throw std::runtime_error("Undefined variable '" + name + "'.");
+        global->value = result;
+        return result;
+      };
+    }
+    return [this, resolved, value = std::move(value)]() {
+      Value result = value();
+      environment->at(resolved.depth, resolved.slot) = result;
+      return result;
+    };
+  }
+
+  void collectGarbage() {
+    heap.collect([this](Heap &heap) {
+      for (const auto &[name, global] : globals)
+        heap.mark(global.value);
+      heap.mark(environment.get());
+      for (const auto &frame : frames)
+        heap.mark(frame.get());
+      for (auto value : temporaries)
+        heap.mark(value);
+      heap.mark(returnValue);
+      heap.mark(tailFunction);
+      for (auto value : tailArguments)
+        heap.mark(value);
+    });
+  }
+
+  // A copy of `method` whose closure binds `this` to `receiver`.
+  ObjFunction *bind(ObjFunction *method, Value receiver) {
+    auto frame = std::make_shared<Environment>(method->closure, 1);
+    frame->slots[0] = receiver;
+    return heap.allocate<ObjFunction>(method->declaration, std::move(frame),
+                                      method->isInitializer);
+  }
+
+  // Fails unless `callee` can be called with `count` arguments, which is
+  // checked before any argument is evaluated.
+  static void checkCall(Value callee, std::size_t count) {
+    std::size_t arity = 0;
+    if (callee.isFunction()) {
+      arity = callee.asFunction()->declaration->params.size();
+    } else if (callee.isClass()) {
+      if (auto initializer = callee.asClass()->initializer)
+        arity = initializer->declaration->params.size();
+    } else {
+      throw std::runtime_error("Can only call functions and classes.");
+    }
+    if (count != arity)
+      throw std::runtime_error("Expected " + std::to_string(arity) +
+                               " arguments but got " + std::to_string(count) +
+                               ".");
+  }
+
+  Completion executeBlock(const StmtClosure &body,
+                          std::shared_ptr<Environment> frame) {
+    frames.push_back(std::exchange(environment, std::move(frame)));
+    auto completion = body();
+    environment = std::move(frames.back());
+    frames.pop_back();
+    return completion;
+  }
+
+  // Runs `body` in a new frame over `slots`, which is allocated on the heap
+  // only if a closure may capture it.
+  Completion executeFrame(const StmtClosure &body,
+                          std::shared_ptr<Environment> enclosing,
+                          std::span<Value> slots, bool captured) {
+    if (captured)
+      return executeBlock(
+          body, std::make_shared<Environment>(std::move(enclosing), slots));
+    Environment frame(std::move(enclosing), slots);
+    return executeBlock(
+        body,
+        std::shared_ptr<Environment>(std::shared_ptr<Environment>(), &frame));
+  }
+
+  // Calls `function` on the arguments from index `arguments` of
+  // `temporaries` up, at expression depth `depth`, then any functions it
+  // tail-calls.
+  Value call(ObjFunction *function, std::size_t arguments, int depth) {
+    Temporaries roots(*this);
+    roots.push(Value::object(function));
+    auto enclosingBase = std::exchange(base, depth);
+    while (true) {
+      if (heap.shouldCollect())
+        collectGarbage();
+      const auto &declaration = *function->declaration;
+      Completion completion;
+      {
+        Arena::Scope scope(arena);
+        auto slots = arena.allocate(declaration.frameSize);
+        std::copy_n(temporaries.begin() +
+                        static_cast<std::ptrdiff_t>(arguments),
+                    declaration.params.size(), slots.begin());
+        completion = executeFrame(bodies.find(&declaration)->second,
+                                  function->closure, slots,
+                                  declaration.captured);
+      }
+      if (completion == Completion::TailCall) {
+        function = tailFunction;
+        temporaries.resize(arguments);
+        temporaries.insert(temporaries.end(), tailArguments.begin(),
+                           tailArguments.end());
+        temporaries.push_back(Value::object(function));
+        continue;
+      }
+      base = enclosingBase;
+      // An initializer always returns the instance, bound at slot 0 of its
+      // closure.
+      if (function->isInitializer)
+        return function->closure->slots[0];
+      return completion == Completion::Return ? returnValue : Value::nil();
+    }
+  }
+
+  // Calls whatever `callee` is, which checkCall() has accepted, with the
+  // arguments from index `arguments` of `temporaries` up.
+  Value invoke(Value callee, std::size_t arguments, int depth) {
+    if (callee.isFunction())
+      return call(callee.asFunction(), arguments, depth);
+    auto klass = callee.asClass();
+    Temporaries roots(*this);
+    auto instance = heap.instance(klass);
+    roots.push(instance);
+    if (klass->initializer != nullptr)
+      call(bind(klass->initializer, instance), arguments, depth);
+    return instance;
+  }
+
+public:
+  explicit ClosureCompiler(int maxDepth = 10000) : maxDepth(maxDepth) {}
+
+  ExprClosure compile(const Expr *expr) {
+    ++level;
+    int deepest = 0;
+    bool checks = false;
+    if (level > checked) {
+      checked = level;
+      if (openCheck == nullptr) {
+        openCheck = &deepest;
+        checks = true;
+      }
+      *openCheck = level;
+    }
+    expr->accept(*this);
+    // Only the first subexpression evaluated can share a check.
+    openCheck = nullptr;
+    --level;
+    if (!checks || (!function && deepest <= maxDepth))
+      return std::move(exprResult);
+    return [this, deepest, inner = std::move(exprResult)]() {
+      if (base + deepest > maxDepth)
+        throw std::runtime_error("Expression nesting too deep");
+      return inner();
+    };
+  }
+
+  StmtClosure compile(Statement *stmt) {
+    stmt->accept(*this);
+    return std::move(stmtResult);
+  }
+
+  LoxValue interpret(const Expr *expr) {
+    base = 0;
+    return toLoxValue(evaluate(expr)());
+  }
+
+  // Resolves and compiles the whole program before running any of it.
+  // Resolution errors are reported through Lox::error and stop the program
+  // from running; runtime errors are thrown as std::runtime_error.
+  void interpret(const std::vector<std::shared_ptr<Statement>> &statements) {
+    Resolver resolver;
+    resolver.resolve(statements);
+    if (Lox::hadError)
+      return;
+    auto program = sequence(statements);
+    // A runtime error may have left the previous run part way through a
+    // call.
+    environment = nullptr;
+    frames.clear();
+    temporaries.clear();
+    base = 0;
+    program();
+  }
+
+  std::any visitLiteral(const Literal &expr) override {
+    auto value = heap.constant(expr.value);
+    exprResult = [value]() { return value; };
+    return {};
+  }
+
+  std::any visitGrouping(const Grouping &expr) override {
+    exprResult = compile(expr.expression.get());
+    return {};
+  }
+
+  std::any visitUnary(const Unary &expr) override {
+    auto right = compile(expr.right.get());
+    switch (expr.op.getType()) {
+    case TokenType::MINUS:
+      exprResult = [right = std::move(right)]() {
+        Value value = right();
+        if (!value.isNumber())
+          throw std::runtime_error("Unary minus must be applied to a number");
+        return Value::number(-value.asNumber());
+      };
+      return {};
+    case TokenType::BANG:
+      exprResult = [right = std::move(right)]() {
+        Value value = right();
+        if (!value.isBool())
+          throw std::runtime_error("Unary bang must be applied to a boolean");
+        return Value::boolean(!value.asBool());
+      };
+      return {};
+    default:
+      throw std::runtime_error("Unknown unary operator");
+    }
+  }
+
+  std::any visitBinary(const Binary &expr) override {
+    switch (expr.op.getType()) {
+    case TokenType::MINUS:
+      exprResult = numeric<TokenType::MINUS>(
+          expr, [](double a, double b) { return Value::number(a - b); });
+      break;
+    case TokenType::SLASH:
+      exprResult = numeric<TokenType::SLASH>(
+          expr, [](double a, double b) { return Value::number(a / b); });
+      break;
+    case TokenType::STAR:
+      exprResult = numeric<TokenType::STAR>(
+          expr, [](double a, double b) { return Value::number(a * b); });
+      break;
+    case TokenType::PLUS:
+      exprResult = numeric<TokenType::PLUS>(
+          expr, [](double a, double b) { return Value::number(a + b); });
+      break;
+    case TokenType::GREATER:
+      exprResult = numeric<TokenType::GREATER>(
+          expr, [](double a, double b) { return Value::boolean(a > b); });
+      break;
+    case TokenType::GREATER_EQUAL:
+      exprResult = numeric<TokenType::GREATER_EQUAL>(
+          expr, [](double a, double b) { return Value::boolean(a >= b); });
+      break;
+    case TokenType::LESS:
+      exprResult = numeric<TokenType::LESS>(
+          expr, [](double a, double b) { return Value::boolean(a < b); });
+      break;
+    case TokenType::LESS_EQUAL:
+      exprResult = numeric<TokenType::LESS_EQUAL>(
+          expr, [](double a, double b) { return Value::boolean(a <= b); });
+      break;
+    case TokenType::BANG_EQUAL:
+      exprResult = equality<false>(expr);
+      break;
+    case TokenType::EQUAL_EQUAL:
+      exprResult = equality<true>(expr);
+      break;
+    default:
+      throw std::runtime_error("Unknown binary operator");
+    }
+    return {};
+  }
+
+  std::any visitAssign(const Assign &expr) override {
+    exprResult =
+        store(expr.name, expr.resolved, compile(expr.value.get()));
+    return {};
+  }
+
+  std::any visitCall(const Call &expr) override {
+    auto callee = compile(expr.callee.get());
+    std::vector<ExprClosure> arguments;
+    for (const auto &argument : expr.arguments)
+      arguments.push_back(compile(argument.get()));
+    // The callee runs at the depth of this node.
+    exprResult = [this, callee = std::move(callee),
+                  arguments = std::move(arguments), depth = level]() {
+      Temporaries roots(*this);
+      Value function = callee();
+      roots.push(function);
+      checkCall(function, arguments.size());
+      auto first = temporaries.size();
+      for (const auto &argument : arguments)
+        roots.push(argument());
+      return invoke(function, first, base + depth);
+    };
+    return {};
+  }
+
+  std::any visitGet(const Get &expr) override {
+    exprResult = [this, object = compile(expr.object.get()),
+                  name = expr.name.getLexeme(),
+                  cache = PropertyCache()]() mutable {
+      Value value = object();
+      if (!value.isInstance())
+        throw std::runtime_error("Only instances have properties.");
+      auto instance = value.asInstance();
+      if (auto cached = cache.find(instance->shape, instance->klass->id))
+        return cached->slot >= 0 ? instance->field(cached->slot)
+                                 : Value::object(bind(cached->method, value));
+
+      // Fields shadow methods.
+      int slot = instance->shape->slotOf(name);
+      if (slot >= 0) {
+        cache.add({instance->shape, instance->shape, slot});
+        return instance->field(slot);
+      }
+      auto method = instance->klass->findMethod(name);
+      if (method == nullptr)
+        throw std::runtime_error("Undefined property '" + name + "'.");
+      cache.add(
+          {instance->shape, instance->shape, -1, instance->klass->id, method});
+      return Value::object(bind(method, value));
+    };
+    return {};
+  }
+
+  std::any visitLogical(const Logical &expr) override {
+    auto left = compile(expr.left.get());
+    // The right operand may not run, so what it checks is not verified
+    // after it.
+    auto verified = checked;
+    auto right = compile(expr.right.get());
+    checked = verified;
+    if (expr.op.getType() == TokenType::OR) {
+      exprResult = [left = std::move(left), right = std::move(right)]() {
+        Value value = left();
+        return value.isFalsey() ? right() : value;
+      };
+    } else {
+      exprResult = [left = std::move(left), right = std::move(right)]() {
+        Value value = left();
+        return value.isFalsey() ? value : right();
+      };
+    }
+    return {};
+  }
+
+  std::any visitSet(const Set &expr) override {
+    auto object = compile(expr.object.get());
+    exprResult = [this, object = std::move(object),
+                  value = compile(expr.value.get()),
+                  name = expr.name.getLexeme(),
+                  cache = PropertyCache()]() mutable {
+      Value target = object();
+      if (!target.isInstance())
+        throw std::runtime_error("Only instances have fields.");
+      Temporaries roots(*this);
+      roots.push(target);
+      Value result = value();
+      auto instance = target.asInstance();
+      auto shape = instance->shape;
+      if (auto cached = cache.find(shape)) {
+        if (cached->transition != shape)
+          instance->transition(cached->transition);
+        instance->field(cached->slot) = result;
+      } else {
+        instance->set(name, result);
+        cache.add({shape, instance->shape, instance->shape->slotOf(name)});
+      }
+      return result;
+    };
+    return {};
+  }
+
+  std::any visitSuper(const Super &expr) override {
+    exprResult = [this, depth = expr.resolved.depth,
+                  name = expr.method.getLexeme()]() {
+      // `this` is bound in the frame just inside the one holding `super`.
+      auto superclass = environment->at(depth, 0).asClass();
+      auto receiver = environment->at(depth - 1, 0);
+      auto method = superclass->findMethod(name);
+      if (method == nullptr)
+        throw std::runtime_error("Undefined property '" + name + "'.");
+      return Value::object(bind(method, receiver));
+    };
+    return {};
+  }
+
+  std::any visitThis(const This &expr) override {
+    exprResult = load(expr.keyword, expr.resolved);
+    return {};
+  }
+
+  std::any visitVariable(const Variable &expr) override {
+    exprResult = load(expr.name, expr.resolved);
+    return {};
+  }
+
+  std::any visitBlock(const Block &stmt) override {
+    stmtResult = [this, body = sequence(stmt.statements),
+                  size = stmt.frameSize, captured = stmt.captured]() {
+      Arena::Scope scope(arena);
+      return executeFrame(body, environment, arena.allocate(size), captured);
+    };
+    return {};
+  }
+
+  std::any visitClass(const Class &stmt) override {
+    ExprClosure superclass;
+    if (stmt.superclass)
+      superclass = evaluate(stmt.superclass.get());
+    for (const auto &method : stmt.methods)
+      compileFunction(*method);
+    stmtResult = [this, &stmt, superclass = std::move(superclass),
+                  global = global(stmt.name, stmt.slot)]() {
+      ObjClass *parent = nullptr;
+      if (superclass) {
+        auto value = superclass();
+        if (!value.isClass())
+          throw std::runtime_error("Superclass must be a class.");
+        parent = value.asClass();
+      }
+
+      auto klass = heap.allocate<ObjClass>(stmt.name.getLexeme(), parent);
+      define(global, stmt.slot, Value::object(klass));
+
+      // Methods of a subclass close over a frame that binds `super`.
+      Environment::promote(environment.get());
+      auto closure = environment;
+      if (parent != nullptr) {
+        closure = std::make_shared<Environment>(environment, 1);
+        closure->slots[0] = Value::object(parent);
+      }
+      for (const auto &method : stmt.methods) {
+        const auto &name = method->name.getLexeme();
+        klass->addMethod(name, heap.allocate<ObjFunction>(
+                                   method.get(), closure, name == "init"));
+      }
+      return Completion::Normal;
+    };
+    return {};
+  }
+
+  std::any visitExpression(const Expression &stmt) override {
+    stmtResult = [expression = evaluate(stmt.expression.get())]() {
+      expression();
+      return Completion::Normal;
+    };
+    return {};
+  }
+
+  std::any visitFunction(const Function &stmt) override {
+    compileFunction(stmt);
+    stmtResult = [this, &stmt, global = global(stmt.name, stmt.slot)]() {
+      // The closure may outlive the frames it captures.
+      Environment::promote(environment.get());
+      auto function = heap.allocate<ObjFunction>(&stmt, environment, false);
+      define(global, stmt.slot, Value::object(function));
+      return Completion::Normal;
+    };
+    return {};
+  }
+
+  std::any visitIf(const If &stmt) override {
+    auto condition = evaluate(stmt.condition.get());
+    auto thenBranch = compile(stmt.thenBranch.get());
+    StmtClosure elseBranch = [] { return Completion::Normal; };
+    if (stmt.elseBranch)
+      elseBranch = compile(stmt.elseBranch.get());
+    stmtResult = [condition = std::move(condition),
+                  thenBranch = std::move(thenBranch),
+                  elseBranch = std::move(elseBranch)]() {
+      if (condition().isFalsey())
+        return elseBranch();
+      return thenBranch();
+    };
+    return {};
+  }
+
+  std::any visitPrint(const Print &stmt) override {
+    stmtResult = [expression = evaluate(stmt.expression.get())]() {
+      std::cout << to_string(expression()) << "\n";
+      return Completion::Normal;
+    };
+    return {};
+  }
+
+  std::any visitReturn(const Return &stmt) override {
+    if (!stmt.tailCall) {
+      ExprClosure value = [] { return Value::nil(); };
+      if (stmt.value)
+        value = evaluate(stmt.value.get());
+      stmtResult = [this, value = std::move(value)]() {
+        returnValue = value();
+        return Completion::Return;
+      };
+      return {};
+    }
+
+    // The callee and arguments of a tail call are each evaluated as a
+    // statement's expression would be, and the callee runs at the depth of
+    // the current call.
+    const auto &tail = static_cast<const Call &>(*stmt.value);
+    auto callee = evaluate(tail.callee.get());
+    std::vector<ExprClosure> arguments;
+    for (const auto &argument : tail.arguments) {
+      level = 0;
+      arguments.push_back(compile(argument.get()));
+    }
+    stmtResult = [this, callee = std::move(callee),
+                  arguments = std::move(arguments)]() {
+      Temporaries roots(*this);
+      Value function = callee();
+      roots.push(function);
+      checkCall(function, arguments.size());
+      auto first = temporaries.size();
+      for (const auto &argument : arguments)
+        roots.push(argument());
+      if (!function.isFunction()) {
+        returnValue = invoke(function, first, base);
+        return Completion::Return;
+      }
+      tailArguments.assign(
+          temporaries.begin() + static_cast<std::ptrdiff_t>(first),
+          temporaries.end());
+      tailFunction = function.asFunction();
+      return Completion::TailCall;
+    };
+    return {};
+  }
+
+  std::any visitVar(const Var &stmt) override {
+    ExprClosure initializer = [] { return Value::nil(); };
+    if (stmt.initializer)
+      initializer = evaluate(stmt.initializer.get());
+    stmtResult = [this, initializer = std::move(initializer),
+                  global = global(stmt.name, stmt.slot), slot = stmt.slot]() {
+      define(global, slot, initializer());
+      return Completion::Normal;
+    };
+    return {};
+  }
+
+  std::any visitWhile(const While &stmt) override {
+    auto condition = evaluate(stmt.condition.get());
+    auto body = compile(stmt.body.get());
+    stmtResult = [this, condition = std::move(condition),
+                  body = std::move(body)]() {
+      while (!condition().isFalsey()) {
+        auto completion = body();
+        if (completion != Completion::Normal)
+          return completion;
+        if (heap.shouldCollect())
+          collectGarbage();
+      }
+      return Completion::Normal;
+    };
+    return {};
+  }
+};
+} // namespace Lox
+
+#endif // LOX_CLOSURECOMPILER_H
@@ -0,0 +1,573 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+#ifndef LOX_COMPILER_H
+#define LOX_COMPILER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Chunk.h"
+#include "Expr.h"
+#include "Statement.h"
+#include "Value.h"
+
+namespace Lox {
+
+// The global variables of a VM. The Compiler numbers each name the first
+// time it is mentioned, so the VM reaches a global by index; it is
+// undefined until a DefineGlobal for it runs.
+struct Globals {
+  std::unordered_map<std::string, uint16_t> indices;
+  std::vector<std::string> names;
+  std::vector<Value> values;
+  std::vector<bool> defined;
+
+  uint16_t indexOf(const std::string &name) {
+    auto found = indices.find(name);
+    if (found != indices.end())
+      return found->second;
+    if (names.size() > UINT16_MAX)
+      throw std::runtime_error("Too many global variables");
+    auto index = static_cast<uint16_t>(names.size());
+    indices.emplace(name, index);
+    names.push_back(name);
+    values.emplace_back();
+    defined.push_back(false);
+    return index;
+  }
+};
+
+// Compiles an AST into a Chunk for the VM, after the Resolver has run.
+//
+// Expressions leave exactly one value on the stack. A frame the Resolver
+// found `captured` is an Environment on the heap, as in the Interpreter;
+// every other one lives on the VM stack, so its variables are plain stack
+// slots. Each function body is compiled to a Chunk of its own.
+//
+// The Interpreter fails once an expression nests maxDepth deep, counting
+// from the depth of the call it runs in. Top-level code runs at depth 0,
+// where the Parser has already bounded every expression, but a function
+// body runs at whatever depth it was called from, so the Compiler emits a
+// Check on the way into the first node of each new level.
+class Compiler : Expr::Visitor, Statement::Visitor {
+  // A frame of the function being compiled. One that is not captured holds
+  // its variables in the stack slots from `base` up.
+  struct Scope {
+    bool captured;
+    int base;
+  };
+
+  Heap &heap;
+  Globals &globals;
+  // Owns the chunks of every function body compiled.
+  std::vector<std::unique_ptr<Chunk>> &bodies;
+  Chunk chunk;
+  int line = 1;
+  int stackDepth = 0;
+  int maxDepth;
+  // The frames of the function being compiled, outermost first. Top-level
+  // code has none of its own.
+  std::vector<Scope> scopes;
+  bool function = false;
+  // How deeply the expression being compiled nests within its statement,
+  // and the deepest level a Check has verified on every path to it.
+  int level = 0;
+  int checked = 0;
+  // The offset just past the last Check, which a Check emitted right after
+  // it is merged into.
+  std::size_t lastCheck = SIZE_MAX;
+
+  Compiler(Heap &heap, Globals &globals,
+           std::vector<std::unique_ptr<Chunk>> &bodies, int maxDepth,
+           bool function)
+      : heap(heap), globals(globals), bodies(bodies), maxDepth(maxDepth),
+        function(function) {}
+
+  void emit(OpCode op) { chunk.write(op, line); }
+
+  void emit(OpCode op, uint16_t operand) {
+    emit(op);
+    chunk.writeShort(operand, line);
+  }
+
+  void emit(OpCode op, uint16_t first, uint16_t second) {
+    emit(op, first);
+    chunk.writeShort(second, line);
+  }
+
+  void push(int count = 1) {
+    stackDepth += count;
+    chunk.maxStack = std::max(chunk.maxStack, stackDepth);
+  }
+
+  void pop(int count = 1) { stackDepth -= count; }
+
+  static uint16_t operand(std::size_t value, const char *what) {
+    if (value > UINT16_MAX)
+      throw std::runtime_error(std::string("Too many ") + what +
+                               " in one chunk");
+    return static_cast<uint16_t>(value);
+  }
+
+  void emitConstant(Value value) {
+    emit(OpCode::Constant,
+         operand(chunk.addConstant(value), "constants"));
+    push();
+  }
+
+  std::size_t emitJump(OpCode op) {
+    emit(op, UINT16_MAX);
+    return chunk.code.size() - 2;
+  }
+
+  void patchJump(std::size_t operand) {
+    auto jump = chunk.code.size() - operand - 2;
+    if (jump > UINT16_MAX)
+      throw std::runtime_error("Too much code to jump over");
+    chunk.code[operand] = static_cast<uint8_t>(jump >> 8);
+    chunk.code[operand + 1] = static_cast<uint8_t>(jump & 0xff);
+    // Code jumped to must not share a Check with code before it.
+    lastCheck = SIZE_MAX;
+  }
+
+  void emitLoop(std::size_t loopStart) {
+    emit(OpCode::Loop);
+    auto offset = chunk.code.size() - loopStart + 2;
+    if (offset > UINT16_MAX)
+      throw std::runtime_error("Loop body too large");
+    chunk.writeShort(static_cast<uint16_t>(offset), line);
+  }
+
+  // Verifies that the depth of the current call plus `level` is within
+  // maxDepth. Consecutive checks have nothing observable between them, so
+  // the later, deeper one replaces the earlier.
+  void check(int level) {
+    if (!function && level <= maxDepth)
+      return;
+    if (lastCheck == chunk.code.size()) {
+      chunk.code[lastCheck - 2] = static_cast<uint8_t>(level >> 8);
+      chunk.code[lastCheck - 1] = static_cast<uint8_t>(level & 0xff);
+      return;
+    }
+    emit(OpCode::Check, static_cast<uint16_t>(level));
+    lastCheck = chunk.code.size();
+  }
+
+  void compile(const Expr *expr) {
+    ++level;
+    if (level > checked) {
+      check(level);
+      checked = level;
+    }
+    expr->accept(*this);
+    --level;
+  }
+
+  // Compiles an expression a statement evaluates.
+  void evaluate(const Expr *expr) {
+    level = 0;
+    checked = 0;
+    compile(expr);
+  }
+
+  void compile(Statement *stmt) { stmt->accept(*this); }
+
+  uint16_t addSite(const Token &name) {
+    chunk.names.push_back(name.getLexeme());
+    chunk.caches.emplace_back();
+    return operand(chunk.names.size() - 1, "property accesses");
+  }
+
+  // The number of heap frames between the innermost frame and the one
+  // `depth` frames out, which is `depth` itself outside the function.
+  int environmentDepth(int depth) const {
+    int own = static_cast<int>(scopes.size());
+    int captured = 0;
+    for (int i = std::max(own - depth, 0); i < own; ++i)
+      if (scopes[i].captured)
+        ++captured;
+    return depth < own ? captured : captured + depth - own;
+  }
+
+  // Loads the variable `resolved` refers to, or with `store` stores the
+  // value on top of the stack to it, leaving the value.
+  void access(const Token &name, const Slot &resolved, bool store) {
+    int own = static_cast<int>(scopes.size());
+    if (resolved.depth < 0) {
+      emit(store ? OpCode::SetGlobal : OpCode::GetGlobal,
+           globals.indexOf(name.getLexeme()));
+    } else if (resolved.depth < own &&
+               !scopes[own - 1 - resolved.depth].captured) {
+      emit(store ? OpCode::SetLocal : OpCode::GetLocal,
+           static_cast<uint16_t>(scopes[own - 1 - resolved.depth].base +
+                                 resolved.slot));
+    } else {
+      emit(store ? OpCode::SetEnv : OpCode::GetEnv,
+           static_cast<uint16_t>(environmentDepth(resolved.depth)),
+           static_cast<uint16_t>(resolved.slot));
+    }
+    if (!store)
+      push();
+  }
+
+  // Binds the value on top of the stack to a declaration's slot, or to a
+  // global, and pops it.
+  void define(int slot, const Token &name) {
+    if (slot < 0) {
+      emit(OpCode::DefineGlobal, globals.indexOf(name.getLexeme()));
+    } else {
+      access(name, {0, slot}, true);
+      emit(OpCode::Pop);
+    }
+    pop();
+  }
+
+  void beginScope(bool captured, int size) {
+    scopes.push_back({captured, stackDepth});
+    // Even an empty captured frame is a link in the chain of frames that
+    // resolved depths count.
+    if (captured) {
+      emit(OpCode::PushEnv, static_cast<uint16_t>(size));
+    } else if (size != 0) {
+      emit(OpCode::Reserve, static_cast<uint16_t>(size));
+      push(size);
+    }
+  }
+
+  void endScope(int size) {
+    if (scopes.back().captured) {
+      emit(OpCode::PopEnv);
+    } else if (size != 0) {
+      emit(OpCode::Release, static_cast<uint16_t>(size));
+      pop(size);
+    }
+    scopes.pop_back();
+  }
+
+  const Chunk *compileFunction(const Function &declaration) {
+    Compiler compiler(heap, globals, bodies, maxDepth, true);
+    compiler.line = declaration.name.getLine();
+    compiler.chunk.declaration = &declaration;
+    // A call frame that is not captured is the callee's arguments, already
+    // on the stack, followed by its other locals.
+    compiler.scopes.push_back({declaration.captured, 0});
+    if (!declaration.captured)
+      compiler.push(declaration.frameSize);
+    for (const auto &stmt : declaration.body)
+      compiler.compile(stmt.get());
+    compiler.emit(OpCode::Nil);
+    compiler.push();
+    compiler.emit(OpCode::Return);
+    bodies.push_back(std::make_unique<Chunk>(std::move(compiler.chunk)));
+    return bodies.back().get();
+  }
+
+  void call(const Call &expr, OpCode op) {
+    auto count = static_cast<uint16_t>(expr.arguments.size());
+    line = expr.paren.getLine();
+    emit(OpCode::CheckCall, count);
+    for (const auto &argument : expr.arguments)
+      compile(argument.get());
+    line = expr.paren.getLine();
+    if (op == OpCode::Call)
+      emit(op, count, static_cast<uint16_t>(level));
+    else
+      emit(op, count);
+    pop(count);
+  }
+
+public:
+  Compiler(Heap &heap, Globals &globals,
+           std::vector<std::unique_ptr<Chunk>> &bodies, int maxDepth = 10000)
+      : Compiler(heap, globals, bodies, maxDepth, false) {}
+
+  // Code that evaluates `expr` and returns its value.
+  Chunk compileExpression(const Expr *expr) {
+    evaluate(expr);
+    emit(OpCode::Return);
+    return std::move(chunk);
+  }
+
+  Chunk compileStatements(
+      const std::vector<std::shared_ptr<Statement>> &statements) {
+    for (const auto &stmt : statements)
+      compile(stmt.get());
+    emit(OpCode::Nil);
+    push();
+    emit(OpCode::Return);
+    return std::move(chunk);
+  }
+
+  std::any visitLiteral(const Literal &expr) override {
+    std::visit(
+        [&](const auto &value) {
+          using T = std::decay_t<decltype(value)>;
+          if constexpr (std::is_same_v<T, double>) {
+            emitConstant(Value::number(value));
+          } else if constexpr (std::is_same_v<T, std::string>) {
+            // Function bodies outlive a run, so their strings go in the
+            // heap's constant pool, which is always a root.
+            emitConstant(heap.constant(value));
+          } else if constexpr (std::is_same_v<T, bool>) {
+            emit(value ? OpCode::True : OpCode::False);
+            push();
+          } else {
+            emit(OpCode::Nil);
+            push();
+          }
+        },
+        expr.value);
+    return {};
+  }
+
+  std::any visitGrouping(const Grouping &expr) override {
+    compile(expr.expression.get());
+    return {};
+  }
+
+  std::any visitUnary(const Unary &expr) override {
+    compile(expr.right.get());
+    line = expr.op.getLine();
+    switch (expr.op.getType()) {
+    case TokenType::MINUS:
+      emit(OpCode::Negate);
+      break;
+    case TokenType::BANG:
+      emit(OpCode::Not);
+      break;
+    default:
+      throw std::runtime_error("Unknown unary operator");
+    }
+    return {};
+  }
+
+  std::any visitBinary(const Binary &expr) override {
+    compile(expr.left.get());
+    compile(expr.right.get());
+    line = expr.op.getLine();
+    switch (expr.op.getType()) {
+    case TokenType::MINUS:
+      emit(OpCode::Subtract);
+      break;
+    case TokenType::SLASH:
+      emit(OpCode::Divide);
+      break;
+    case TokenType::STAR:
+      emit(OpCode::Multiply);
+      break;
+    case TokenType::PLUS:
+      emit(OpCode::Add);
+      break;
+    case TokenType::GREATER:
+      emit(OpCode::Greater);
+      break;
+    case TokenType::GREATER_EQUAL:
+      emit(OpCode::GreaterEqual);
+      break;
+    case TokenType::LESS:
+      emit(OpCode::Less);
+      break;
+    case TokenType::LESS_EQUAL:
+      emit(OpCode::LessEqual);
+      break;
+    case TokenType::BANG_EQUAL:
+      emit(OpCode::NotEqual);
+      break;
+    case TokenType::EQUAL_EQUAL:
+      emit(OpCode::Equal);
+      break;
+    default:
+      throw std::runtime_error("Unknown binary operator");
+    }
+    pop();
+    return {};
+  }
+
+  std::any visitAssign(const Assign &expr) override {
+    compile(expr.value.get());
+    line = expr.name.getLine();
+    access(expr.name, expr.resolved, true);
+    return {};
+  }
+
+  std::any visitCall(const Call &expr) override {
+    compile(expr.callee.get());
+    call(expr, OpCode::Call);
+    return {};
+  }
+
+  std::any visitGet(const Get &expr) override {
+    compile(expr.object.get());
+    line = expr.name.getLine();
+    emit(OpCode::Get, addSite(expr.name));
+    return {};
+  }
+
+  std::any visitLogical(const Logical &expr) override {
+    compile(expr.left.get());
+    line = expr.op.getLine();
+    // Jumps over the right operand keeping the left one as the result, or
+    // pops it.
+    auto jump = emitJump(expr.op.getType() == TokenType::OR ? OpCode::Or
+                                                            : OpCode::And);
+    pop();
+    auto verified = checked;
+    compile(expr.right.get());
+    checked = verified;
+    patchJump(jump);
+    return {};
+  }
+
+  std::any visitSet(const Set &expr) override {
+    compile(expr.object.get());
+    line = expr.name.getLine();
+    emit(OpCode::CheckInstance);
+    compile(expr.value.get());
+    line = expr.name.getLine();
+    emit(OpCode::Set, addSite(expr.name));
+    pop();
+    return {};
+  }
+
+  std::any visitSuper(const Super &expr) override {
+    line = expr.keyword.getLine();
+    emit(OpCode::Super, addSite(expr.method),
+         static_cast<uint16_t>(environmentDepth(expr.resolved.depth)));
+    push();
+    return {};
+  }
+
+  std::any visitThis(const This &expr) override {
+    access(expr.keyword, expr.resolved, false);
+    return {};
+  }
+
+  std::any visitVariable(const Variable &expr) override {
+    line = expr.name.getLine();
+    access(expr.name, expr.resolved, false);
+    return {};
+  }
+
+  std::any visitBlock(const Block &stmt) override {
+    beginScope(stmt.captured, stmt.frameSize);
+    for (const auto &statement : stmt.statements)
+      compile(statement.get());
+    endScope(stmt.frameSize);
+    return {};
+  }
+
+  std::any visitClass(const Class &stmt) override {
+    line = stmt.name.getLine();
+    if (stmt.superclass)
+      evaluate(stmt.superclass.get());
+    ClassCode code{&stmt, {}};
+    for (const auto &method : stmt.methods)
+      code.methods.push_back(compileFunction(*method));
+    chunk.classes.push_back(std::move(code));
+    line = stmt.name.getLine();
+    emit(OpCode::Class, operand(chunk.classes.size() - 1, "classes"));
+    if (stmt.superclass)
+      pop();
+    push();
+    define(stmt.slot, stmt.name);
+    return {};
+  }
+
+  std::any visitExpression(const Expression &stmt) override {
+    evaluate(stmt.expression.get());
+    emit(OpCode::Pop);
+    pop();
+    return {};
+  }
+
+  std::any visitFunction(const Function &stmt) override {
+    chunk.functions.push_back(compileFunction(stmt));
+    line = stmt.name.getLine();
+    emit(OpCode::Closure, operand(chunk.functions.size() - 1, "functions"));
+    push();
+    define(stmt.slot, stmt.name);
+    return {};
+  }
+
+  std::any visitIf(const If &stmt) override {
+    evaluate(stmt.condition.get());
+    auto thenJump = emitJump(OpCode::JumpIfFalse);
+    pop();
+    compile(stmt.thenBranch.get());
+    if (stmt.elseBranch) {
+      auto elseJump = emitJump(OpCode::Jump);
+      patchJump(thenJump);
+      compile(stmt.elseBranch.get());
+      patchJump(elseJump);
+    } else {
+      patchJump(thenJump);
+    }
+    return {};
+  }
+
+  std::any visitPrint(const Print &stmt) override {
+    evaluate(stmt.expression.get());
+    emit(OpCode::Print);
+    pop();
+    return {};
+  }
+
+  std::any visitReturn(const Return &stmt) override {
+    line = stmt.keyword.getLine();
+    if (!stmt.tailCall) {
+      if (stmt.value) {
+        evaluate(stmt.value.get());
+      } else {
+        emit(OpCode::Nil);
+        push();
+      }
+      emit(OpCode::Return);
+      pop();
+      return {};
+    }
+
+    // A tail call runs the callee in place of the current call, at the same
+    // depth; its callee and arguments are each evaluated as a statement's
+    // expression would be. TailCall makes any other call normally and
+    // leaves its result for the Return.
+    const auto &tail = static_cast<const Call &>(*stmt.value);
+    evaluate(tail.callee.get());
+    call(tail, OpCode::TailCall);
+    emit(OpCode::Return);
+    pop();
+    return {};
+  }
+
+  std::any visitVar(const Var &stmt) override {
+    if (stmt.initializer) {
+      evaluate(stmt.initializer.get());
+    } else {
+      emit(OpCode::Nil);
+      push();
+    }
+    define(stmt.slot, stmt.name);
+    return {};
+  }
+
+  std::any visitWhile(const While &stmt) override {
+    auto loopStart = chunk.code.size();
+    lastCheck = SIZE_MAX;
+    evaluate(stmt.condition.get());
+    auto exitJump = emitJump(OpCode::JumpIfFalse);
+    pop();
+    compile(stmt.body.get());
+    emitLoop(loopStart);
+    patchJump(exitJump);
+    return {};
+  }
+};
+} // namespace Lox
+
+#endif // LOX_COMPILER_H
@@ -0,0 +1,997 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+#ifndef LOX_CPPEMITTER_H
+#define LOX_CPPEMITTER_H
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include "CppPrelude.h"
+#include "Expr.h"
+#include "Ir.h"
+#include "IrLowering.h"
+#include "IrOptimizer.h"
+#include "Lox.h"
+#include "Resolver.h"
+#include "Statement.h"
+#include "TypeInference.h"
+
+namespace Lox {
+
+// Translates a program into a self-contained C++ translation unit that
+// behaves as the Interpreter does: same output, same runtime errors at the
+// same points, including "Expression nesting too deep".
+//
+// Expressions are flattened into one C++ local per node, in evaluation
+// order. Frames are laid out by the Resolver's slots; they are plain C++
+// arrays unless the function or top level creating them declares a function
+// or class, which could capture them, and runtime Env objects otherwise.
+// Every Function - including methods - becomes a C++ function taking its
+// closure. Globals are static variables, so nothing is looked up by name.
+//
+// TypeInference decides which values are held as raw doubles: numbers
+// proven by it skip lox::Value and its type checks entirely, locals that
+// only ever hold numbers get a double of their own, and everything else
+// falls back to the generic runtime.
+//
+// Bodies of functions IrLowering supports are instead written from their
+// IR once IrOptimizer has run, with calls to small global functions
+// inlined; the others, and the top level, are emitted from the AST.
+//
+// The Interpreter's depth limit counts nested expressions, starting from
+// the depth at which the current function was called. Within the
+// evaluation of one top-level expression nodes are visited in a fixed
+// order, so only the first node at each level needs a check; at top level
+// the depth is known and even that is done here.
+class CppEmitter : Expr::Visitor, Statement::Visitor {
+  // A C++ expression holding a value: a lox::Value, or a double when
+  // `number` is set.
+  struct Operand {
+    std::string code;
+    bool number = false;
+  };
+
+  // A frame of an enclosing scope.
+  struct Scope {
+    // The variable holding it.
+    std::string name;
+    // The Block or Function it belongs to.
+    const void *owner;
+  };
+
+  // A C++ function being written.
+  struct Body {
+    std::ostringstream code;
+    int indent = 1;
+    int temporaries = 0;
+    std::vector<Scope> scopes;
+    TypeInference types;
+    // Whether this is a Lox function rather than the top level.
+    bool function = false;
+    // Whether frames are Env objects, which closures can hold, rather than
+    // arrays.
+    bool boxed = false;
+    // The deepest level to check before the next line runs. Checks with
+    // no code between them are merged into the deepest, which fails
+    // whenever a shallower one would.
+    int enter = 0;
+  };
+
+  std::vector<Body> bodies;
+  std::ostringstream globals;
+  std::ostringstream functions;
+  std::unordered_map<std::string, std::string> globalNames;
+  std::unordered_map<std::string, std::string> stringNames;
+  // Global functions calls to which may be inlined.
+  std::unordered_map<std::string, const Function *> constantFunctions;
+  int functionCount = 0;
+  int scopeCount = 0;
+  // The value of the expression just visited.
+  Operand result;
+  // The level of the node being emitted, and the deepest level already
+  // checked, within the current top-level expression.
+  int level = 0;
+  int checked = 0;
+  int maxDepth;
+  // Whether functions are compiled through IrLowering and IrOptimizer.
+  bool optimize;
+
+  Body &body() { return bodies.back(); }
+
+  void line(const std::string &text) {
+    if (body().enter > 0) {
+      auto level = std::to_string(body().enter);
+      body().enter = 0;
+      line("lox::enter(" + level + ");");
+    }
+    body().code << std::string(2 * body().indent, ' ') << text << "\n";
+  }
+
+  Operand temporary(const std::string &value) {
+    auto name = "t" + std::to_string(body().temporaries++);
+    line("lox::Value " + name + " = " + value + ";");
+    return {name};
+  }
+
+  Operand number(const std::string &value) {
+    auto name = "t" + std::to_string(body().temporaries++);
+    line("double " + name + " = " + value + ";");
+    return {name, true};
+  }
+
+  static std::string boxed(const Operand &operand) {
+    return operand.number ? "lox::number(" + operand.code + ")"
+                          : operand.code;
+  }
+
+  // `operand`, which must be known to be a number, as a double.
+  static std::string unboxed(const Operand &operand) {
+    return operand.number ? operand.code : operand.code + ".asNumber()";
+  }
+
+  static std::string quote(const std::string &text) {
+    std::string quoted = "\"";
+    for (unsigned char c : text) {
+      if (c == '"' || c == '\\') {
+        quoted += '\\';
+        quoted += static_cast<char>(c);
+      } else if (c < 0x20 || c >= 0x7f) {
+        char escape[5];
+        std::snprintf(escape, sizeof escape, "\\%03o", c);
+        quoted += escape;
+      } else {
+        quoted += static_cast<char>(c);
+      }
+    }
+    return quoted + "\"";
+  }
+
+  static std::string numberLiteral(double number) {
+    if (std::isinf(number))
+      return "std::numeric_limits<double>::infinity()";
+    char buffer[32];
+    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), number);
+    std::string text(buffer, end);
+    if (text.find_first_of(".e") == std::string::npos)
+      text += ".0";
+    return text;
+  }
+
+  Operand
+  literal(const std::variant<double, std::string, bool, nullptr_t> &value) {
+    return std::visit(
+        [&](const auto &value) -> Operand {
+          using T = std::decay_t<decltype(value)>;
+          if constexpr (std::is_same_v<T, double>)
+            return {numberLiteral(value), true};
+          else if constexpr (std::is_same_v<T, std::string>)
+            return {stringConstant(value)};
+          else if constexpr (std::is_same_v<T, bool>)
+            return {value ? "lox::boolean(true)" : "lox::boolean(false)"};
+          else
+            return {"lox::Value()"};
+        },
+        value);
+  }
+
+  std::string global(const std::string &name) {
+    auto &global = globalNames[name];
+    if (global.empty()) {
+      global = "g" + std::to_string(globalNames.size() - 1);
+      globals << "static lox::Global " << global << "{" << quote(name)
+              << "};\n";
+    }
+    return global;
+  }
+
+  std::string stringConstant(const std::string &value) {
+    auto &constant = stringNames[value];
+    if (constant.empty()) {
+      constant = "s" + std::to_string(stringNames.size() - 1);
+      globals << "static const lox::Value " << constant << " = lox::string("
+              << quote(value) << ");\n";
+    }
+    return constant;
+  }
+
+  // Whether any of `statements` declares a function or class, outside the
+  // bodies of other functions.
+  static bool
+  captures(const std::vector<std::shared_ptr<Statement>> &statements) {
+    for (const auto &statement : statements)
+      if (captures(statement.get()))
+        return true;
+    return false;
+  }
+
+  static bool captures(const Statement *stmt) {
+    if (stmt == nullptr)
+      return false;
+    if (dynamic_cast<const Function *>(stmt) ||
+        dynamic_cast<const Class *>(stmt))
+      return true;
+    if (auto block = dynamic_cast<const Block *>(stmt))
+      return captures(block->statements);
+    if (auto branch = dynamic_cast<const If *>(stmt))
+      return captures(branch->thenBranch.get()) ||
+             captures(branch->elseBranch.get());
+    if (auto loop = dynamic_cast<const While *>(stmt))
+      return captures(loop->body.get());
+    return false;
+  }
+
+  // The frame new closures and frames should enclose.
+  std::string currentScope() {
+    return body().scopes.empty() ? "nullptr" : body().scopes.back().name;
+  }
+
+  std::string slots(const std::string &scope) {
+    return body().boxed ? scope + "->slots" : scope;
+  }
+
+  static std::string unboxedLocal(const Scope &scope, int slot) {
+    return scope.name + "_" + std::to_string(slot);
+  }
+
+  // Declares the frame of `owner` in a C++ local named `scope`, along with
+  // a double for each of its locals that is unboxed.
+  void frame(const std::string &scope, const void *owner, int frameSize,
+             const std::string &enclosing) {
+    if (body().boxed)
+      line("auto " + scope + " = std::make_shared<lox::Env>(" + enclosing +
+           ", " + std::to_string(frameSize) + ");");
+    else if (frameSize > 0)
+      line("lox::Value " + scope + "[" + std::to_string(frameSize) + "];");
+    body().scopes.push_back({scope, owner});
+    for (auto slot : body().types.unboxedSlots(owner))
+      line("double " + unboxedLocal(body().scopes.back(), slot) + " = 0;");
+  }
+
+  // Where the variable `resolved` refers to is stored, as an lvalue.
+  Operand variable(const Token &name, const Slot &resolved) {
+    const auto &scopes = body().scopes;
+    auto own = static_cast<int>(scopes.size());
+    if (resolved.depth < 0)
+      return {global(name.getLexeme())};
+    if (resolved.depth < own) {
+      const auto &scope = scopes[own - 1 - resolved.depth];
+      if (body().types.isUnboxed({scope.owner, resolved.slot}))
+        return {unboxedLocal(scope, resolved.slot), true};
+      return {slots(scope.name) + "[" + std::to_string(resolved.slot) + "]"};
+    }
+    return {"self.closure->at(" + std::to_string(resolved.depth - own) +
+            ", " + std::to_string(resolved.slot) + ")"};
+  }
+
+  void define(int slot, const Token &name, const Operand &value) {
+    if (slot < 0) {
+      line(global(name.getLexeme()) + ".define(" + boxed(value) + ");");
+      return;
+    }
+    const auto &scope = body().scopes.back();
+    if (body().types.isUnboxed({scope.owner, slot}))
+      line(unboxedLocal(scope, slot) + " = " + unboxed(value) + ";");
+    else
+      line(slots(scope.name) + "[" + std::to_string(slot) +
+           "] = " + boxed(value) + ";");
+  }
+
+  // Emits a node nested one level inside the current one.
+  Operand emit(const Expr *expr) {
+    ++level;
+    if (level > checked) {
+      checked = level;
+      if (level > maxDepth) {
+        // Too deep however shallow the call: this is always an error.
+        line("lox::fail(\"Expression nesting too deep\");");
+        --level;
+        return {"lox::Value()"};
+      }
+      if (body().function)
+        body().enter = level;
+    }
+    expr->accept(*this);
+    --level;
+    return std::move(result);
+  }
+
+  // Emits an expression a statement evaluates.
+  Operand evaluate(const Expr *expr) {
+    level = 0;
+    checked = 0;
+    return emit(expr);
+  }
+
+  void emit(Statement *stmt) { stmt->accept(*this); }
+
+  void emitBlock(const Block &block, const std::string &enclosing) {
+    frame("e" + std::to_string(scopeCount++), &block, block.frameSize,
+          enclosing);
+    for (const auto &statement : block.statements)
+      emit(statement.get());
+    body().scopes.pop_back();
+  }
+
+  // Writes a C++ function for `declaration` and returns its name.
+  std::string emitFunction(const Function &declaration) {
+    auto name = "f" + std::to_string(functionCount++);
+    bodies.emplace_back();
+    body().function = true;
+    if (!optimize || !emitIr(declaration)) {
+      body().boxed = captures(declaration.body);
+      body().types.analyse(declaration);
+      frame("e", &declaration, declaration.frameSize, "self.closure");
+      for (std::size_t i = 0; i < declaration.params.size(); ++i)
+        line(slots("e") + "[" + std::to_string(i) + "] = arguments[" +
+             std::to_string(i) + "];");
+      for (const auto &statement : declaration.body)
+        emit(statement.get());
+      line("return lox::Value();");
+    }
+
+    functions << "// " << declaration.name.getLexeme() << "\n"
+              << "static lox::Value " << name
+              << "([[maybe_unused]] lox::Function &self, "
+                 "[[maybe_unused]] lox::Value *arguments) {\n"
+              << body().code.str() << "}\n\n";
+    bodies.pop_back();
+    return name;
+  }
+
+  Operand irValue(const IrInstruction *value) {
+    if (value->op == IrOp::Constant)
+      return literal(value->constant);
+    return {"v" + std::to_string(value->id), value->number};
+  }
+
+  std::string irBoxed(const IrInstruction *value) {
+    return boxed(irValue(value));
+  }
+
+  // Assigns the Phis of `target` their operands for the edge from `from`,
+  // then jumps there.
+  std::string irJump(const IrBlock *from, const IrBlock *target) {
+    std::string code;
+    auto edge = std::find(target->predecessors.begin(),
+                          target->predecessors.end(), from) -
+                target->predecessors.begin();
+    for (auto instruction : target->instructions) {
+      if (instruction->op != IrOp::Phi)
+        break;
+      auto operand = irValue(instruction->operands[edge]);
+      code += "v" + std::to_string(instruction->id) + "_next = " +
+              (instruction->number ? unboxed(operand) : boxed(operand)) +
+              "; ";
+    }
+    return code + "goto b" + std::to_string(target->id) + ";";
+  }
+
+  // Emits the arithmetic or comparison `instruction`.
+  std::string irBinary(const IrInstruction *instruction) {
+    auto left = irValue(instruction->operands[0]);
+    auto right = irValue(instruction->operands[1]);
+    const char *op;
+    const char *function;
+    switch (instruction->op) {
+    case IrOp::Add:
+      op = "+";
+      function = "lox::add";
+      break;
+    case IrOp::Subtract:
+      op = "-";
+      function = "lox::subtract";
+      break;
+    case IrOp::Multiply:
+      op = "*";
+      function = "lox::multiply";
+      break;
+    case IrOp::Divide:
+      op = "/";
+      function = "lox::divide";
+      break;
+    case IrOp::Greater:
+      op = ">";
+      function = "lox::greater";
+      break;
+    case IrOp::GreaterEqual:
+      op = ">=";
+      function = "lox::greaterEqual";
+      break;
+    case IrOp::Less:
+      op = "<";
+      function = "lox::less";
+      break;
+    case IrOp::LessEqual:
+      op = "<=";
+      function = "lox::lessEqual";
+      break;
+    case IrOp::Equal:
+      op = "==";
+      function = nullptr;
+      break;
+    default:
+      op = "!=";
+      function = nullptr;
+    }
+    if (left.number && right.number) {
+      auto code = left.code + " " + op + " " + right.code;
+      return instruction->number ? code : "lox::boolean(" + code + ")";
+    }
+    auto operands = boxed(left) + ", " + boxed(right);
+    if (function == nullptr)
+      return std::string("lox::boolean(") +
+             (instruction->op == IrOp::Equal ? "" : "!") + "lox::equal(" +
+             operands + "))";
+    auto code = std::string(function) + "(" + operands + ")";
+    return instruction->number ? code + ".asNumber()" : code;
+  }
+
+  // The C++ expression computing the value `instruction` defines.
+  std::string irExpression(const IrInstruction *instruction) {
+    const auto &operands = instruction->operands;
+    switch (instruction->op) {
+    case IrOp::Param:
+      return "arguments[" + std::to_string(instruction->index) + "]";
+    case IrOp::Unbox:
+      return unboxed(irValue(operands[0]));
+    case IrOp::Negate:
+      if (operands[0]->number)
+        return "-" + irValue(operands[0]).code;
+      return "lox::negate(" + irBoxed(operands[0]) + ").asNumber()";
+    case IrOp::Not:
+      return "lox::bang(" + irBoxed(operands[0]) + ")";
+    case IrOp::LoadGlobal:
+      return global(instruction->name) + ".get()";
+    case IrOp::LoadOuter:
+      return "self.closure->at(" + std::to_string(instruction->depth) + ", " +
+             std::to_string(instruction->slot) + ")";
+    case IrOp::Get:
+      return "lox::get(" + irBoxed(operands[0]) + ", " +
+             quote(instruction->name) + ")";
+    case IrOp::Super:
+      return "lox::super(" + irBoxed(operands[0]) + ", " +
+             irBoxed(operands[1]) + ", " + quote(instruction->name) + ")";
+    case IrOp::Call: {
+      if (operands.size() == 1)
+        return "lox::call(" + irBoxed(operands[0]) + ", nullptr, " +
+               std::to_string(instruction->index) + ")";
+      std::string values;
+      for (std::size_t i = 1; i < operands.size(); ++i)
+        values += (i == 1 ? "" : ", ") + irBoxed(operands[i]);
+      auto name = "a" + std::to_string(body().temporaries++);
+      line("lox::Value " + name + "[] = {" + values + "};");
+      return "lox::call(" + irBoxed(operands[0]) + ", " + name + ", " +
+             std::to_string(instruction->index) + ")";
+    }
+    default:
+      return irBinary(instruction);
+    }
+  }
+
+  // Emits the effect or terminator `instruction`.
+  void irStatement(const IrInstruction *instruction) {
+    const auto &operands = instruction->operands;
+    switch (instruction->op) {
+    case IrOp::StoreGlobal:
+      line(global(instruction->name) + ".assign(" + irBoxed(operands[0]) +
+           ");");
+      break;
+    case IrOp::DefineGlobal:
+      line(global(instruction->name) + ".define(" + irBoxed(operands[0]) +
+           ");");
+      break;
+    case IrOp::StoreOuter:
+      line("self.closure->at(" + std::to_string(instruction->depth) + ", " +
+           std::to_string(instruction->slot) +
+           ") = " + irBoxed(operands[0]) + ";");
+      break;
+    case IrOp::CheckCall:
+      line("lox::checkCall(" + irBoxed(operands[0]) + ", " +
+           std::to_string(instruction->index) + ");");
+      break;
+    case IrOp::RequireInstance:
+      line("lox::requireInstance(" + irBoxed(operands[0]) + ");");
+      break;
+    case IrOp::SetField:
+      line("lox::set(" + irBoxed(operands[0]) + ", " +
+           quote(instruction->name) + ", " + irBoxed(operands[1]) + ");");
+      break;
+    case IrOp::Enter:
+      line("lox::enter(" + std::to_string(instruction->index) + ");");
+      break;
+    case IrOp::Fail:
+      line("lox::fail(" + quote(instruction->name) + ");");
+      break;
+    case IrOp::Print:
+      line("std::cout << lox::toString(" + irBoxed(operands[0]) +
+           ") << \"\\n\";");
+      break;
+    case IrOp::Jump:
+      line(irJump(instruction->block, instruction->targets[0]));
+      break;
+    case IrOp::Branch:
+      line("if (!lox::isFalsey(" + irBoxed(operands[0]) + ")) {");
+      line("  " + irJump(instruction->block, instruction->targets[0]));
+      line("}");
+      line(irJump(instruction->block, instruction->targets[1]));
+      break;
+    case IrOp::Return:
+      line("return " + irBoxed(operands[0]) + ";");
+      break;
+    case IrOp::TailCall: {
+      std::string arguments;
+      for (std::size_t i = 1; i < operands.size(); ++i)
+        arguments += (i == 1 ? "" : ", ") + irBoxed(operands[i]);
+      line("return lox::tail(" + irBoxed(operands[0]) + ", {" + arguments +
+           "});");
+      break;
+    }
+    default:
+      break;
+    }
+  }
+
+  // Writes the body of `declaration` from its optimized IR, with a C++
+  // local per value and a label per block. Returns false, having written
+  // nothing, for functions IrLowering does not support.
+  bool emitIr(const Function &declaration) {
+    IrFunction function;
+    try {
+      function = IrLowering(maxDepth, constantFunctions).lower(declaration);
+    } catch (const IrLowering::Unsupported &) {
+      return false;
+    }
+    IrOptimizer(function).run();
+
+    // Values used only in the block defining them are declared there, and
+    // the rest up front, as gotos may not jump past a declaration.
+    auto uses = function.uses();
+    auto local = [&](const IrInstruction *value) {
+      for (auto use : uses[value->id])
+        if (use->block != value->block)
+          return false;
+      return value->op != IrOp::Phi;
+    };
+    auto type = [](const IrInstruction *value) {
+      return value->number ? "double " : "lox::Value ";
+    };
+    for (const auto &block : function.blocks) {
+      for (auto instruction : block->instructions) {
+        if (!instruction->definesValue() ||
+            instruction->op == IrOp::Constant ||
+            uses[instruction->id].empty() || local(instruction))
+          continue;
+        auto name = "v" + std::to_string(instruction->id);
+        auto zero = instruction->number ? " = 0;" : ";";
+        line(type(instruction) + name + zero);
+        if (instruction->op == IrOp::Phi)
+          line(type(instruction) + name + "_next" + zero);
+      }
+    }
+    for (const auto &block : function.blocks) {
+      if (!block->predecessors.empty())
+        body().code << "b" << block->id << ":\n";
+      line("{");
+      ++body().indent;
+      for (auto instruction : block->instructions) {
+        // Constants are written where they are used.
+        if (instruction->op == IrOp::Constant)
+          continue;
+        auto name = "v" + std::to_string(instruction->id);
+        if (instruction->op == IrOp::Phi) {
+          line(name + " = " + name + "_next;");
+        } else if (!instruction->definesValue()) {
+          irStatement(instruction);
+        } else if (uses[instruction->id].empty()) {
+          line(irExpression(instruction) + ";");
+        } else if (local(instruction)) {
+          line(type(instruction) + name + " = " + irExpression(instruction) +
+               ";");
+        } else {
+          line(name + " = " + irExpression(instruction) + ";");
+        }
+      }
+      --body().indent;
+      line("}");
+    }
+    return true;
+  }
+
+  // Emits the arguments of a call into an array and returns its name.
+  std::string emitArguments(const Call &expr) {
+    if (expr.arguments.empty())
+      return "nullptr";
+    std::string values;
+    for (const auto &argument : expr.arguments)
+      values += (values.empty() ? "" : ", ") + boxed(emit(argument.get()));
+    auto name = "a" + std::to_string(body().temporaries++);
+    line("lox::Value " + name + "[] = {" + values + "};");
+    return name;
+  }
+
+  void write(std::ostream &out) {
+    out << "// Generated by lox --emit-cpp.\n"
+        << "#define LOX_MAX_DEPTH " << maxDepth << "\n"
+        << cppPrelude << "\n"
+        << globals.str() << "\n"
+        << functions.str() << "int main() {\n"
+        << "  try {\n"
+        << body().code.str() << "  } catch (const lox::RuntimeError &error) {\n"
+        << "    return lox::report(error);\n"
+        << "  }\n"
+        << "  return 0;\n"
+        << "}\n";
+  }
+
+public:
+  // maxDepth must match the Interpreter's the program is to behave like.
+  explicit CppEmitter(int maxDepth = 10000, bool optimize = true)
+      : maxDepth(maxDepth), optimize(optimize) {}
+
+  // Writes a program that evaluates `expr` and prints its value, as the
+  // `lox` command does.
+  void emit(const Expr *expr, std::ostream &out) {
+    bodies.emplace_back();
+    body().indent = 2;
+    auto value = evaluate(expr);
+    line("std::cout << lox::toString(" + boxed(value) + ") << \"\\n\";");
+    write(out);
+    bodies.clear();
+  }
+
+  // Writes a program that runs `statements`. They are resolved first, and
+  // nothing is written if that reports an error through Lox::error.
+  void emit(const std::vector<std::shared_ptr<Statement>> &statements,
+            std::ostream &out) {
+    Resolver resolver;
+    resolver.resolve(statements);
+    if (Lox::hadError)
+      return;
+    constantFunctions = resolver.constantFunctions();
+    bodies.emplace_back();
+    body().indent = 2;
+    body().boxed = captures(statements);
+    body().types.analyse(statements);
+    for (const auto &statement : statements)
+      emit(statement.get());
+    write(out);
+    bodies.clear();
+  }
+
+  std::any visitLiteral(const Literal &expr) override {
+    result = literal(expr.value);
+    return {};
+  }
+
+  std::any visitGrouping(const Grouping &expr) override {
+    result = emit(expr.expression.get());
+    return {};
+  }
+
+  std::any visitUnary(const Unary &expr) override {
+    auto right = emit(expr.right.get());
+    switch (expr.op.getType()) {
+    case TokenType::MINUS:
+      if (right.number)
+        result = number("-" + right.code);
+      else
+        result = temporary("lox::negate(" + right.code + ")");
+      break;
+    case TokenType::BANG:
+      result = temporary("lox::bang(" + boxed(right) + ")");
+      break;
+    default:
+      line("lox::fail(\"Unknown unary operator\");");
+      result = {"lox::Value()"};
+    }
+    return {};
+  }
+
+  // Emits an operator both of whose operands are known to be numbers.
+  void emitNumeric(TokenType op, const Operand &left, const Operand &right) {
+    auto operands = [&](const char *op) {
+      return left.code + " " + op + " " + right.code;
+    };
+    switch (op) {
+    case TokenType::PLUS:
+      result = number(operands("+"));
+      break;
+    case TokenType::MINUS:
+      result = number(operands("-"));
+      break;
+    case TokenType::STAR:
+      result = number(operands("*"));
+      break;
+    case TokenType::SLASH:
+      result = number(operands("/"));
+      break;
+    case TokenType::GREATER:
+      result = temporary("lox::boolean(" + operands(">") + ")");
+      break;
+    case TokenType::GREATER_EQUAL:
+      result = temporary("lox::boolean(" + operands(">=") + ")");
+      break;
+    case TokenType::LESS:
+      result = temporary("lox::boolean(" + operands("<") + ")");
+      break;
+    case TokenType::LESS_EQUAL:
+      result = temporary("lox::boolean(" + operands("<=") + ")");
+      break;
+    case TokenType::EQUAL_EQUAL:
+      result = temporary("lox::boolean(" + operands("==") + ")");
+      break;
+    case TokenType::BANG_EQUAL:
+      result = temporary("lox::boolean(" + operands("!=") + ")");
+      break;
+    default:
+      line("lox::fail(\"Unknown binary operator\");");
+      result = {"lox::Value()"};
+    }
+  }
+
+  std::any visitBinary(const Binary &expr) override {
+    auto left = emit(expr.left.get());
+    auto right = emit(expr.right.get());
+    if (left.number && right.number) {
+      emitNumeric(expr.op.getType(), left, right);
+      return {};
+    }
+
+    auto operands = boxed(left) + ", " + boxed(right);
+    const char *function;
+    switch (expr.op.getType()) {
+    case TokenType::PLUS:
+      function = "lox::add";
+      break;
+    case TokenType::MINUS:
+      function = "lox::subtract";
+      break;
+    case TokenType::STAR:
+      function = "lox::multiply";
+      break;
+    case TokenType::SLASH:
+      function = "lox::divide";
+      break;
+    case TokenType::GREATER:
+      function = "lox::greater";
+      break;
+    case TokenType::GREATER_EQUAL:
+      function = "lox::greaterEqual";
+      break;
+    case TokenType::LESS:
+      function = "lox::less";
+      break;
+    case TokenType::LESS_EQUAL:
+      function = "lox::lessEqual";
+      break;
+    case TokenType::EQUAL_EQUAL:
+      result = temporary("lox::boolean(lox::equal(" + operands + "))");
+      return {};
+    case TokenType::BANG_EQUAL:
+      result = temporary("lox::boolean(!lox::equal(" + operands + "))");
+      return {};
+    default:
+      line("lox::fail(\"Unknown binary operator\");");
+      result = {"lox::Value()"};
+      return {};
+    }
+    result = temporary(std::string(function) + "(" + operands + ")");
+    return {};
+  }
+
+  std::any visitAssign(const Assign &expr) override {
+    auto value = emit(expr.value.get());
+    auto target = variable(expr.name, expr.resolved);
+    if (expr.resolved.depth < 0)
+      line(target.code + ".assign(" + boxed(value) + ");");
+    else if (target.number)
+      line(target.code + " = " + unboxed(value) + ";");
+    else
+      line(target.code + " = " + boxed(value) + ";");
+    result = value;
+    return {};
+  }
+
+  std::any visitCall(const Call &expr) override {
+    auto callee = boxed(emit(expr.callee.get()));
+    line("lox::checkCall(" + callee + ", " +
+         std::to_string(expr.arguments.size()) + ");");
+    auto arguments = emitArguments(expr);
+    result = temporary("lox::call(" + callee + ", " + arguments + ", " +
+                       std::to_string(level) + ")");
+    return {};
+  }
+
+  std::any visitGet(const Get &expr) override {
+    auto object = boxed(emit(expr.object.get()));
+    result = temporary("lox::get(" + object + ", " +
+                       quote(expr.name.getLexeme()) + ")");
+    return {};
+  }
+
+  std::any visitLogical(const Logical &expr) override {
+    auto value = temporary(boxed(emit(expr.left.get())));
+    // `or` stops at a truthy left operand and `and` at a falsey one.
+    auto stop = expr.op.getType() == TokenType::OR ? "" : "!";
+    line(std::string("if (") + stop + "lox::isFalsey(" + value.code + ")) {");
+    ++body().indent;
+    // The right operand may be skipped, so the checks emitted within it do
+    // not cover the nodes after it.
+    auto outerChecked = checked;
+    auto right = emit(expr.right.get());
+    line(value.code + " = " + boxed(right) + ";");
+    checked = outerChecked;
+    --body().indent;
+    line("}");
+    result = value;
+    return {};
+  }
+
+  std::any visitSet(const Set &expr) override {
+    auto object = boxed(emit(expr.object.get()));
+    line("lox::requireInstance(" + object + ");");
+    auto value = emit(expr.value.get());
+    line("lox::set(" + object + ", " + quote(expr.name.getLexeme()) + ", " +
+         boxed(value) + ");");
+    result = value;
+    return {};
+  }
+
+  std::any visitSuper(const Super &expr) override {
+    // `this` is bound in the frame just inside the one holding `super`.
+    Slot receiver{expr.resolved.depth - 1, 0};
+    result = temporary(
+        "lox::super(" + variable(expr.keyword, expr.resolved).code + ", " +
+        variable(expr.keyword, receiver).code + ", " +
+        quote(expr.method.getLexeme()) + ")");
+    return {};
+  }
+
+  std::any visitThis(const This &expr) override {
+    result = temporary(variable(expr.keyword, expr.resolved).code);
+    return {};
+  }
+
+  std::any visitVariable(const Variable &expr) override {
+    auto source = variable(expr.name, expr.resolved);
+    if (expr.resolved.depth < 0)
+      result = temporary(source.code + ".get()");
+    else if (source.number || body().types.isNumber(&expr))
+      result = number(unboxed(source));
+    else
+      result = temporary(source.code);
+    return {};
+  }
+
+  std::any visitBlock(const Block &stmt) override {
+    line("{");
+    ++body().indent;
+    emitBlock(stmt, currentScope());
+    --body().indent;
+    line("}");
+    return {};
+  }
+
+  std::any visitClass(const Class &stmt) override {
+    std::string superclass = "lox::Value()";
+    if (stmt.superclass) {
+      superclass = boxed(evaluate(stmt.superclass.get()));
+      line("lox::requireClass(" + superclass + ");");
+    }
+    auto klass = temporary("lox::makeClass(" + quote(stmt.name.getLexeme()) +
+                           ", " + superclass + ")");
+    define(stmt.slot, stmt.name, klass);
+
+    // Methods of a subclass close over a frame that binds `super`.
+    auto closure = currentScope();
+    if (stmt.superclass) {
+      closure = "e" + std::to_string(scopeCount++);
+      line("auto " + closure + " = std::make_shared<lox::Env>(" +
+           currentScope() + ", 1);");
+      line(closure + "->slots[0] = " + superclass + ";");
+    }
+    for (const auto &method : stmt.methods) {
+      auto code = emitFunction(*method);
+      line("lox::addMethod(" + klass.code + ", " +
+           quote(method->name.getLexeme()) + ", " +
+           std::to_string(method->params.size()) + ", &" + code + ", " +
+           closure + ");");
+    }
+    return {};
+  }
+
+  std::any visitExpression(const Expression &stmt) override {
+    evaluate(stmt.expression.get());
+    return {};
+  }
+
+  std::any visitFunction(const Function &stmt) override {
+    auto code = emitFunction(stmt);
+    auto function = temporary(
+        "lox::function(" + quote(stmt.name.getLexeme()) + ", " +
+        std::to_string(stmt.params.size()) + ", &" + code + ", " +
+        currentScope() + ")");
+    define(stmt.slot, stmt.name, function);
+    return {};
+  }
+
+  std::any visitIf(const If &stmt) override {
+    auto condition = boxed(evaluate(stmt.condition.get()));
+    line("if (!lox::isFalsey(" + condition + ")) {");
+    ++body().indent;
+    emit(stmt.thenBranch.get());
+    --body().indent;
+    if (stmt.elseBranch) {
+      line("} else {");
+      ++body().indent;
+      emit(stmt.elseBranch.get());
+      --body().indent;
+    }
+    line("}");
+    return {};
+  }
+
+  std::any visitPrint(const Print &stmt) override {
+    auto value = boxed(evaluate(stmt.expression.get()));
+    line("std::cout << lox::toString(" + value + ") << \"\\n\";");
+    return {};
+  }
+
+  std::any visitReturn(const Return &stmt) override {
+    if (!stmt.value) {
+      line("return lox::Value();");
+      return {};
+    }
+    if (!stmt.tailCall) {
+      line("return " + boxed(evaluate(stmt.value.get())) + ";");
+      return {};
+    }
+
+    // The call node itself is not evaluated as an expression, and the
+    // callee runs at the depth of the function it replaces.
+    const auto &tail = static_cast<const Call &>(*stmt.value);
+    auto callee = boxed(evaluate(tail.callee.get()));
+    line("lox::checkCall(" + callee + ", " +
+         std::to_string(tail.arguments.size()) + ");");
+    std::string arguments;
+    for (const auto &argument : tail.arguments)
+      arguments += (arguments.empty() ? "" : ", ") +
+                   boxed(evaluate(argument.get()));
+    line("return lox::tail(" + callee + ", {" + arguments + "});");
+    return {};
+  }
+
+  std::any visitVar(const Var &stmt) override {
+    Operand value{"lox::Value()"};
+    if (stmt.initializer)
+      value = evaluate(stmt.initializer.get());
+    define(stmt.slot, stmt.name, value);
+    return {};
+  }
+
+  std::any visitWhile(const While &stmt) override {
+    line("while (true) {");
+    ++body().indent;
+    auto condition = boxed(evaluate(stmt.condition.get()));
+    line("if (lox::isFalsey(" + condition + "))");
+    line("  break;");
+    emit(stmt.body.get());
+    --body().indent;
+    line("}");
+    return {};
+  }
+};
+} // namespace Lox
+
+#endif // LOX_CPPEMITTER_H
@@ -0,0 +1,416 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+#ifndef LOX_CPPPRELUDE_H
+#define LOX_CPPPRELUDE_H
+
+#include <string_view>
+
+namespace Lox {
+
+// The runtime every program emitted by CppEmitter starts with, so the
+// translation unit builds on its own with any C++20 compiler. Values,
+// messages and printing follow the Interpreter's exactly. Objects are
+// reference counted, so cycles - such as a closure stored in the frame it
+// captures - are never reclaimed.
+//
+// The emitter defines LOX_MAX_DEPTH, the Interpreter's maxDepth, before
+// this text.
+inline constexpr std::string_view cppPrelude = R"prelude(
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace lox {
+struct Function;
+struct Class;
+struct Instance;
+
+struct RuntimeError : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+[[noreturn]] inline void fail(const std::string &message) {
+  throw RuntimeError(message);
+}
+
+struct Value {
+  std::variant<std::monostate, bool, double, std::shared_ptr<const std::string>,
+               std::shared_ptr<Function>, std::shared_ptr<Class>,
+               std::shared_ptr<Instance>>
+      data;
+
+  bool isNil() const { return data.index() == 0; }
+  bool isBool() const { return data.index() == 1; }
+  bool isNumber() const { return data.index() == 2; }
+  bool isString() const { return data.index() == 3; }
+  bool isFunction() const { return data.index() == 4; }
+  bool isClass() const { return data.index() == 5; }
+  bool isInstance() const { return data.index() == 6; }
+
+  // Callers have checked the type, or proven it, so these do not.
+  bool asBool() const { return *std::get_if<1>(&data); }
+  double asNumber() const { return *std::get_if<2>(&data); }
+  const std::string &asString() const { return **std::get_if<3>(&data); }
+  const std::shared_ptr<Function> &asFunction() const {
+    return *std::get_if<4>(&data);
+  }
+  const std::shared_ptr<Class> &asClass() const {
+    return *std::get_if<5>(&data);
+  }
+  const std::shared_ptr<Instance> &asInstance() const {
+    return *std::get_if<6>(&data);
+  }
+};
+
+inline Value boolean(bool value) { return {value}; }
+
+inline Value number(double value) {
+  if (value != value)
+    value = std::numeric_limits<double>::quiet_NaN();
+  return {value};
+}
+
+inline Value string(std::string value) {
+  return {std::make_shared<const std::string>(std::move(value))};
+}
+
+// A block or call frame.
+struct Env {
+  std::shared_ptr<Env> enclosing;
+  std::vector<Value> slots;
+
+  Env(std::shared_ptr<Env> enclosing, std::size_t size)
+      : enclosing(std::move(enclosing)), slots(size) {}
+
+  Value &at(int depth, int slot) {
+    auto env = this;
+    for (; depth > 0; --depth)
+      env = env->enclosing.get();
+    return env->slots[slot];
+  }
+};
+
+using Code = Value (*)(Function &self, Value *arguments);
+
+struct Function {
+  std::string name;
+  std::size_t arity;
+  Code code;
+  std::shared_ptr<Env> closure;
+  bool isInitializer;
+};
+
+// Method tables are flattened, as in the Interpreter.
+struct Class {
+  std::string name;
+  std::unordered_map<std::string, std::shared_ptr<Function>> methods;
+  std::shared_ptr<Function> initializer;
+};
+
+struct Instance {
+  std::shared_ptr<Class> klass;
+  std::unordered_map<std::string, Value> fields;
+};
+
+struct Global {
+  const char *name;
+  bool defined = false;
+  Value value;
+
+  explicit Global(const char *name) : name(name) {}
+
+  const Value &get() const {
+    if (!defined)
+      fail(std::string("Undefined variable '") + name + "'.");
+    return value;
+  }
+
+  void assign(const Value &to) {
+    get();
+    value = to;
+  }
+
+  void define(const Value &to) {
+    defined = true;
+    value = to;
+  }
+};
+
+// The expression depth at which the running function body is evaluated.
+inline int depth = 0;
+
+inline void enter(int level) {
+  if (depth + level > LOX_MAX_DEPTH)
+    fail("Expression nesting too deep");
+}
+
+inline std::string toString(const Value &value) {
+  if (value.isNumber()) {
+    // As the interpreter prints numbers: whole ones below 1e21 in full.
+    double number = value.asNumber();
+    char buffer[32];
+    auto [end, ec] =
+        std::trunc(number) == number && std::fabs(number) < 1e21
+            ? std::to_chars(buffer, buffer + sizeof(buffer), number,
+                            std::chars_format::fixed)
+            : std::to_chars(buffer, buffer + sizeof(buffer), number);
+    return {buffer, end};
+  }
+  if (value.isBool())
+    return value.asBool() ? "true" : "false";
+  if (value.isString())
+    return value.asString();
+  if (value.isFunction())
+    return "<fn " + value.asFunction()->name + ">";
+  if (value.isClass())
+    return value.asClass()->name;
+  if (value.isInstance())
+    return value.asInstance()->klass->name + " instance";
+  return "nil";
+}
+
+inline bool isFalsey(const Value &value) {
+  return value.isNil() || (value.isBool() && !value.asBool());
+}
+
+inline bool equal(const Value &a, const Value &b) {
+  if (a.data.index() != b.data.index())
+    return false;
+  switch (a.data.index()) {
+  case 0:
+    return true;
+  case 1:
+    return a.asBool() == b.asBool();
+  case 2:
+    return a.asNumber() == b.asNumber();
+  case 3:
+    return a.asString() == b.asString();
+  case 4:
+    return a.asFunction() == b.asFunction();
+  case 5:
+    return a.asClass() == b.asClass();
+  default:
+    return a.asInstance() == b.asInstance();
+  }
+}
+
+inline void numbers(const Value &a, const Value &b) {
+  if (!a.isNumber() || !b.isNumber())
+    fail("Operands must be numbers");
+}
+
+inline Value add(const Value &a, const Value &b) {
+  if (a.isNumber() && b.isNumber())
+    return number(a.asNumber() + b.asNumber());
+  if (a.isString() && b.isString())
+    return string(a.asString() + b.asString());
+  fail("Operands must be two numbers or two strings");
+}
+
+inline Value subtract(const Value &a, const Value &b) {
+  numbers(a, b);
+  return number(a.asNumber() - b.asNumber());
+}
+
+inline Value multiply(const Value &a, const Value &b) {
+  numbers(a, b);
+  return number(a.asNumber() * b.asNumber());
+}
+
+inline Value divide(const Value &a, const Value &b) {
+  numbers(a, b);
+  return number(a.asNumber() / b.asNumber());
+}
+
+inline Value greater(const Value &a, const Value &b) {
+  numbers(a, b);
+  return boolean(a.asNumber() > b.asNumber());
+}
+
+inline Value greaterEqual(const Value &a, const Value &b) {
+  numbers(a, b);
+  return boolean(a.asNumber() >= b.asNumber());
+}
+
+inline Value less(const Value &a, const Value &b) {
+  numbers(a, b);
+  return boolean(a.asNumber() < b.asNumber());
+}
+
+inline Value lessEqual(const Value &a, const Value &b) {
+  numbers(a, b);
+  return boolean(a.asNumber() <= b.asNumber());
+}
+
+inline Value negate(const Value &value) {
+  if (!value.isNumber())
+    fail("Unary minus must be applied to a number");
+  return number(-value.asNumber());
+}
+
+inline Value bang(const Value &value) {
+  if (!value.isBool())
+    fail("Unary bang must be applied to a boolean");
+  return boolean(!value.asBool());
+}
+
+inline std::shared_ptr<Function> bind(const std::shared_ptr<Function> &method,
+                                      const Value &receiver) {
+  auto frame = std::make_shared<Env>(method->closure, 1);
+  frame->slots[0] = receiver;
+  return std::make_shared<Function>(Function{method->name, method->arity,
+                                             method->code, std::move(frame),
+                                             method->isInitializer});
+}
+
+inline void arity(std::size_t expected, std::size_t count) {
+  if (expected != count)
+    fail("Expected " + std::to_string(expected) + " arguments but got " +
+         std::to_string(count) + ".");
+}
+
+// Fails as calling `callee` with `count` arguments does before any of them
+// is evaluated.
+inline void checkCall(const Value &callee, std::size_t count) {
+  if (callee.isFunction())
+    return arity(callee.asFunction()->arity, count);
+  if (callee.isClass()) {
+    const auto &initializer = callee.asClass()->initializer;
+    return arity(initializer ? initializer->arity : 0, count);
+  }
+  fail("Can only call functions and classes.");
+}
+
+// Set by a call in tail position, which the enclosing run() then makes in
+// place of the function that returned.
+struct TailCall {
+  bool pending = false;
+  std::shared_ptr<Function> function;
+  std::vector<Value> arguments;
+};
+
+inline TailCall tailCall;
+
+inline Value run(Function *function, Value *arguments) {
+  // Owns the callee and arguments of a tail call once its caller returns.
+  std::shared_ptr<Function> callee;
+  std::vector<Value> values;
+  while (true) {
+    auto value = function->code(*function, arguments);
+    if (!tailCall.pending)
+      return function->isInitializer ? function->closure->slots[0] : value;
+    tailCall.pending = false;
+    callee = std::move(tailCall.function);
+    values = std::move(tailCall.arguments);
+    function = callee.get();
+    arguments = values.data();
+  }
+}
+
+// Calls `callee`, which checkCall accepted, from an expression nested
+// `level` deep in the caller.
+inline Value call(const Value &callee, Value *arguments, int level) {
+  depth += level;
+  Value result;
+  if (callee.isFunction()) {
+    result = run(callee.asFunction().get(), arguments);
+  } else {
+    const auto &klass = callee.asClass();
+    result.data = std::make_shared<Instance>(Instance{klass, {}});
+    if (klass->initializer)
+      run(bind(klass->initializer, result).get(), arguments);
+  }
+  depth -= level;
+  return result;
+}
+
+inline Value tail(const Value &callee, std::vector<Value> arguments) {
+  if (!callee.isFunction())
+    return call(callee, arguments.data(), 0);
+  tailCall = {true, callee.asFunction(), std::move(arguments)};
+  return {};
+}
+
+inline Value get(const Value &object, const std::string &name) {
+  if (!object.isInstance())
+    fail("Only instances have properties.");
+  const auto &instance = *object.asInstance();
+  auto field = instance.fields.find(name);
+  if (field != instance.fields.end())
+    return field->second;
+  auto method = instance.klass->methods.find(name);
+  if (method == instance.klass->methods.end())
+    fail("Undefined property '" + name + "'.");
+  return {bind(method->second, object)};
+}
+
+inline void requireInstance(const Value &object) {
+  if (!object.isInstance())
+    fail("Only instances have fields.");
+}
+
+inline void set(const Value &object, const std::string &name,
+                const Value &value) {
+  object.asInstance()->fields[name] = value;
+}
+
+inline Value super(const Value &superclass, const Value &receiver,
+                   const std::string &name) {
+  const auto &methods = superclass.asClass()->methods;
+  auto method = methods.find(name);
+  if (method == methods.end())
+    fail("Undefined property '" + name + "'.");
+  return {bind(method->second, receiver)};
+}
+
+inline void requireClass(const Value &superclass) {
+  if (!superclass.isClass())
+    fail("Superclass must be a class.");
+}
+
+inline Value makeClass(std::string name, const Value &superclass) {
+  auto klass = std::make_shared<Class>();
+  klass->name = std::move(name);
+  if (superclass.isClass()) {
+    klass->methods = superclass.asClass()->methods;
+    klass->initializer = superclass.asClass()->initializer;
+  }
+  return {std::move(klass)};
+}
+
+inline void addMethod(const Value &klass, std::string name, std::size_t arity,
+                      Code code, std::shared_ptr<Env> closure) {
+  bool isInitializer = name == "init";
+  auto method = std::make_shared<Function>(
+      Function{name, arity, code, std::move(closure), isInitializer});
+  if (isInitializer)
+    klass.asClass()->initializer = method;
+  klass.asClass()->methods[std::move(name)] = std::move(method);
+}
+
+inline Value function(std::string name, std::size_t arity, Code code,
+                      std::shared_ptr<Env> closure) {
+  return {std::make_shared<Function>(
+      Function{std::move(name), arity, code, std::move(closure), false})};
+}
+
+inline int report(const RuntimeError &error) {
+  std::cerr << "Runtime error: " << error.what() << std::endl;
+  return 0;
+}
+} // namespace lox
+)prelude";
+} // namespace Lox
+
+#endif // LOX_CPPPRELUDE_H
@@ -0,0 +1,69 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+#ifndef LOX_ENVIRONMENT_H
+#define LOX_ENVIRONMENT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <utility>
+
+#include "Value.h"
+
+namespace Lox {
+
+// A frame of local variables for one scope. Its size is fixed by the
+// Resolver, so variables are addressed by slot index rather than by name.
+//
+// The slots either belong to the frame or are borrowed from an Arena scope.
+// Borrowed slots disappear when that scope ends, so a frame that is going to
+// outlive it - because a closure captured it - must be promoted first.
+class Environment {
+  std::unique_ptr<Value[]> owned;
+
+public:
+  std::shared_ptr<Environment> enclosing;
+  std::span<Value> slots;
+  // The last garbage collection that marked this frame.
+  uint64_t epoch = 0;
+
+  // A frame that owns its slots.
+  Environment(std::shared_ptr<Environment> enclosing, int size)
+      : owned(std::make_unique<Value[]>(size)),
+        enclosing(std::move(enclosing)), slots(owned.get(), size) {}
+
+  // A frame whose slots are borrowed from an Arena.
+  Environment(std::shared_ptr<Environment> enclosing, std::span<Value> slots)
+      : enclosing(std::move(enclosing)), slots(slots) {}
+
+  [[nodiscard]] bool isBorrowed() const {
+    return owned == nullptr && !slots.empty();
+  }
+
+  Value &at(int depth, int slot) {
+    Environment *environment = this;
+    for (int i = 0; i < depth; ++i)
+      environment = environment->enclosing.get();
+    return environment->slots[slot];
+  }
+
+  // Gives `environment` and every frame enclosing it slots of their own.
+  // Owned frames only ever enclose owned frames, so the walk stops at the
+  // first one.
+  static void promote(Environment *environment) {
+    for (; environment != nullptr && environment->isBorrowed();
+         environment = environment->enclosing.get()) {
+      auto size = environment->slots.size();
+      environment->owned = std::make_unique<Value[]>(size);
+      std::copy(environment->slots.begin(), environment->slots.end(),
+                environment->owned.get());
+      environment->slots = {environment->owned.get(), size};
+    }
+  }
+};
+} // namespace Lox
+
+#endif // LOX_ENVIRONMENT_H
@@ -4,4 +4,26 @@
 
 #include "Expr.h"
 
-namespace Lox {} // namespace Lox
\ No newline at end of file
+namespace Lox {
+void Expr::release(std::shared_ptr<Expr> &child) {
+  // Never destroyed: the Expr trees kept in static variables are released
+  // during static destruction, after thread-locals are gone.
+  thread_local auto &pending = *new std::vector<std::shared_ptr<Expr>>;
+  thread_local bool draining = false;
+
+  if (!child)
+    return;
+  pending.push_back(std::move(child));
+  if (draining)
+    return;
+
+  draining = true;
+  while (!pending.empty()) {
+    // Destroying the last reference runs the node's destructor, which queues
+    // its own children here instead of recursing into them.
+    auto node = std::move(pending.back());
+    pending.pop_back();
+  }
+  draining = false;
+}
+} // namespace Lox
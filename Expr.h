@@ -5,12 +5,16 @@
 #ifndef LOX_EXPR_H
 #define LOX_EXPR_H
 
+#include <algorithm>
+#include <cstdint>
 #include <memory>
 #include <utility>
 #include <variant>
 #include <vector>
 
+#include "InlineCache.h"
 #include "Token.h"
+#include "Value.h"
 
 namespace Lox {
 struct Expr;
@@ -27,6 +31,14 @@ struct This;
 struct Unary;
 struct Variable;
 
+// Where a variable reference lives at runtime, filled in by the Resolver:
+// `depth` frames out from the current one, at index `slot`. A depth of -1
+// means the variable is global and is looked up by name.
+struct Slot {
+  int depth = -1;
+  int slot = -1;
+};
+
 struct Expr {
   virtual ~Expr() = default;
 
@@ -47,14 +59,30 @@ struct Expr {
   };
 
   virtual std::any accept(Visitor &visitor) const = 0;
+
+  // The number of nodes on the longest path from this one to a leaf: how
+  // deeply evaluating it nests. The Parser rejects expressions taller than
+  // the Interpreter's maxDepth.
+  int height = 1;
+
+protected:
+  // Drops a child subtree without recursing: nodes that become unreferenced
+  // are queued and destroyed one at a time by the outermost release(), so
+  // tearing down a very deep tree uses constant stack.
+  static void release(std::shared_ptr<Expr> &child);
 };
 
 struct Assign : public Expr {
   Token name;
   std::shared_ptr<Expr> value;
+  mutable Slot resolved;
 
   Assign(Token name, std::shared_ptr<Expr> value)
-      : name(std::move(name)), value(std::move(value)) {}
+      : name(std::move(name)), value(std::move(value)) {
+    height = 1 + this->value->height;
+  }
+
+  ~Assign() override { release(value); }
 
   std::any accept(Visitor &visitor) const override {
     return visitor.visitAssign(*this);
@@ -67,7 +95,14 @@ struct Binary : public Expr {
   std::shared_ptr<Expr> right;
 
   Binary(std::shared_ptr<Expr> left, Token op, std::shared_ptr<Expr> right)
-      : left(std::move(left)), op(std::move(op)), right(std::move(right)) {}
+      : left(std::move(left)), op(std::move(op)), right(std::move(right)) {
+    height = 1 + std::max(this->left->height, this->right->height);
+  }
+
+  ~Binary() override {
+    release(left);
+    release(right);
+  }
 
   std::any accept(Visitor &visitor) const override {
     return visitor.visitBinary(*this);
@@ -82,7 +117,18 @@ struct Call : public Expr {
   Call(std::shared_ptr<Expr> callee, Token paren,
        std::vector<std::shared_ptr<Expr>> arguments)
       : callee(std::move(callee)), paren(std::move(paren)),
-        arguments(std::move(arguments)) {}
+        arguments(std::move(arguments)) {
+    height = this->callee->height;
+    for (const auto &argument : this->arguments)
+      height = std::max(height, argument->height);
+    ++height;
+  }
+
+  ~Call() override {
+    release(callee);
+    for (auto &argument : arguments)
+      release(argument);
+  }
 
   std::any accept(Visitor &visitor) const override {
     return visitor.visitCall(*this);
@@ -92,16 +138,29 @@ struct Call : public Expr {
 struct Get : public Expr {
   std::shared_ptr<Expr> object;
   Token name;
+  mutable PropertyCache cache;
 
   Get(std::shared_ptr<Expr> object, Token name)
-      : object(std::move(object)), name(std::move(name)) {}
+      : object(std::move(object)), name(std::move(name)) {
+    height = 1 + this->object->height;
+  }
+
+  ~Get() override { release(object); }
+
+  std::any accept(Visitor &visitor) const override {
+    return visitor.visitGet(*this);
+  }
 };
 
 struct Grouping : public Expr {
   std::shared_ptr<Expr> expression;
 
   explicit Grouping(std::shared_ptr<Expr> expression)
-      : expression(std::move(expression)) {}
+      : expression(std::move(expression)) {
+    height = 1 + this->expression->height;
+  }
+
+  ~Grouping() override { release(expression); }
 
   std::any accept(Visitor &visitor) const override {
     return visitor.visitGrouping(*this);
@@ -110,6 +169,10 @@ struct Grouping : public Expr {
 
 struct Literal : public Expr {
   std::variant<double, std::string, bool, nullptr_t> value;
+  // This literal's entry in the constant pool of the Heap whose id is
+  // `pool`, filled in the first time it is evaluated against that Heap.
+  mutable Value constant;
+  mutable uint64_t pool = 0;
   explicit Literal(std::variant<double, std::string, bool, nullptr_t> value)
       : value(std::move(value)) {}
 
@@ -124,7 +187,14 @@ struct Logical : public Expr {
   std::shared_ptr<Expr> right;
 
   Logical(std::shared_ptr<Expr> left, Token op, std::shared_ptr<Expr> right)
-      : left(std::move(left)), op(std::move(op)), right(std::move(right)) {}
+      : left(std::move(left)), op(std::move(op)), right(std::move(right)) {
+    height = 1 + std::max(this->left->height, this->right->height);
+  }
+
+  ~Logical() override {
+    release(left);
+    release(right);
+  }
 
   std::any accept(Visitor &visitor) const override {
     return visitor.visitLogical(*this);
@@ -135,10 +205,18 @@ struct Set : public Expr {
   std::shared_ptr<Expr> object;
   Token name;
   std::shared_ptr<Expr> value;
+  mutable PropertyCache cache;
 
   Set(std::shared_ptr<Expr> object, Token name, std::shared_ptr<Expr> value)
       : object(std::move(object)), name(std::move(name)),
-        value(std::move(value)) {}
+        value(std::move(value)) {
+    height = 1 + std::max(this->object->height, this->value->height);
+  }
+
+  ~Set() override {
+    release(object);
+    release(value);
+  }
 
   std::any accept(Visitor &visitor) const override {
     return visitor.visitSet(*this);
@@ -148,6 +226,7 @@ struct Set : public Expr {
 struct Super : public Expr {
   Token keyword;
   Token method;
+  mutable Slot resolved;
 
   Super(Token keyword, Token method)
       : keyword(std::move(keyword)), method(std::move(method)) {}
@@ -159,6 +238,7 @@ struct Super : public Expr {
 
 struct This : public Expr {
   Token keyword;
+  mutable Slot resolved;
 
   explicit This(Token keyword) : keyword(std::move(keyword)) {}
 
@@ -172,7 +252,11 @@ struct Unary : public Expr {
   std::shared_ptr<Expr> right;
 
   Unary(Token op, std::shared_ptr<Expr> right)
-      : op(std::move(op)), right(std::move(right)) {}
+      : op(std::move(op)), right(std::move(right)) {
+    height = 1 + this->right->height;
+  }
+
+  ~Unary() override { release(right); }
 
   std::any accept(Visitor &visitor) const override {
     return visitor.visitUnary(*this);
@@ -181,6 +265,7 @@ struct Unary : public Expr {
 
 struct Variable : public Expr {
   Token name;
+  mutable Slot resolved;
 
   explicit Variable(Token name) : name(std::move(name)) {}
 
@@ -0,0 +1,70 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+#ifndef LOX_INLINECACHE_H
+#define LOX_INLINECACHE_H
+
+#include <array>
+#include <cstdint>
+
+namespace Lox {
+class Shape;
+struct ObjFunction;
+
+// Process-wide counts of inline cache lookups, for measuring how well
+// property access sites stay monomorphic.
+struct InlineCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+};
+
+inline InlineCacheStats inlineCacheStats;
+
+// A per-site cache for a property access, keyed on the receiver's Shape.
+//
+// The first shapes seen at a site are remembered together with the slot
+// their property lives at; a hit costs one pointer compare per entry and
+// skips the name lookup entirely. `transition` is the shape a Set moves the
+// receiver to, which is the receiver's own shape unless the store adds the
+// field. When the property is a method rather than a field, `slot` is -1
+// and the entry also has to match the receiver's class id. Once `capacity`
+// entries have been added the site is megamorphic and further misses take
+// the slow path without being cached.
+class PropertyCache {
+public:
+  static constexpr int capacity = 4;
+
+  struct Entry {
+    const Shape *shape = nullptr;
+    Shape *transition = nullptr;
+    int slot = -1;
+    uint64_t classId = 0;
+    ObjFunction *method = nullptr;
+  };
+
+private:
+  std::array<Entry, capacity> entries;
+  int size = 0;
+
+public:
+  const Entry *find(const Shape *shape, uint64_t classId = 0) {
+    for (int i = 0; i < size; ++i) {
+      if (entries[i].shape == shape &&
+          (entries[i].slot >= 0 || entries[i].classId == classId)) {
+        ++inlineCacheStats.hits;
+        return &entries[i];
+      }
+    }
+    ++inlineCacheStats.misses;
+    return nullptr;
+  }
+
+  void add(const Entry &entry) {
+    if (size < capacity)
+      entries[size++] = entry;
+  }
+};
+} // namespace Lox
+
+#endif // LOX_INLINECACHE_H
@@ -5,119 +5,624 @@
 #ifndef LOX_INTERPRETER_H
 #define LOX_INTERPRETER_H
 
+#include "Arena.h"
+#include "BinaryDispatch.h"
+#include "Environment.h"
 #include "Expr.h"
+#include "Jit.h"
+#include "Resolver.h"
+#include "Statement.h"
+#include "Value.h"
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <variant>
+#include <vector>
 namespace Lox {
-using LoxValue = std::variant<double, std::string, bool, std::nullptr_t>;
 
-class Interpreter : Expr::Visitor {
+// Tree-walking evaluator.
+//
+// Visitor methods leave their value in `result` and return an empty std::any,
+// so evaluating an expression never boxes a value into std::any and numeric
+// code performs no heap allocation at all.
+//
+// Control flow that leaves a statement early - `return`, a tail call or a
+// runtime error - is recorded in `completion` and checked by each caller on
+// the way out, rather than thrown. Errors become exceptions only at the
+// public interpret() boundary.
+class Interpreter : Expr::Visitor, Statement::Visitor {
+  // How the most recent statement or expression finished.
+  enum class Completion { Normal, Return, TailCall, Error };
+
+  Heap heap;
+  Value result;
+  std::unordered_map<std::string, Value> globals;
+  std::shared_ptr<Environment> environment;
+  // Environments of the blocks and calls that are suspended while an inner
+  // one runs.
+  std::vector<std::shared_ptr<Environment>> frames;
+  // Values held only by C++ locals across the evaluation of a subexpression
+  // that may run statements, and so collect garbage.
+  std::vector<Value> temporaries;
+  // Slot storage for block and call frames, released as each one exits.
+  Arena arena;
+  Jit jit;
+  int depth = 0;
+  int maxDepth;
+
+  // Pushes temporaries that stay rooted until the guard goes out of scope.
+  class Temporaries {
+    std::vector<Value> &stack;
+    std::size_t size;
 
-  LoxValue result;
+  public:
+    explicit Temporaries(Interpreter &interpreter)
+        : stack(interpreter.temporaries), size(stack.size()) {}
+    Temporaries(const Temporaries &) = delete;
+    Temporaries &operator=(const Temporaries &) = delete;
+    ~Temporaries() { stack.resize(size); }
+
+    void push(Value value) { stack.push_back(value); }
+  };
+
+  Completion completion = Completion::Normal;
+  // The value of a completed `return`.
+  Value returnValue;
+  // The message of a runtime error being propagated.
+  std::string errorMessage;
+  // A `return` of a call to a function completes with TailCall, and the
+  // enclosing call() runs tailFunction on tailArguments in place of the
+  // current frame, so tail-recursive functions run in constant stack and
+  // memory.
+  ObjFunction *tailFunction = nullptr;
+  std::vector<Value> tailArguments;
+
+  [[nodiscard]] bool abrupt() const {
+    return completion != Completion::Normal;
+  }
+
+  // Starts propagating a runtime error. Returns an empty std::any so
+  // visitors can `return fail(...)`.
+  std::any fail(std::string message) {
+    completion = Completion::Error;
+    errorMessage = std::move(message);
+    return {};
+  }
+
+  // Rethrows a runtime error that propagated out to the public interface.
+  void throwIfFailed() {
+    if (completion != Completion::Error)
+      return;
+    completion = Completion::Normal;
+    throw std::runtime_error(std::move(errorMessage));
+  }
+
+  // The variable's storage, or null after failing if it is an undefined
+  // global.
+  Value *lookUp(const Token &name, const Slot &resolved) {
+    if (resolved.depth >= 0)
+      return &environment->at(resolved.depth, resolved.slot);
+    auto found = globals.find(name.getLexeme());
+    if (found == globals.end()) {
+      fail("Undefined variable '" + name.getLexeme() + "'.");
+      return nullptr;
+    }
+    return &found->second;
+  }
+
+  // Binds a declaration to its resolved slot, or to a global.
+  void define(int slot, const Token &name, Value value) {
+    if (slot < 0)
+      globals[name.getLexeme()] = value;
+    else
+      environment->slots[slot] = value;
+  }
+
+
+  // Statement boundaries are the collector's safe points: every live value
+  // is then in a global, an environment, `result` or `temporaries`.
+  void execute(Statement *stmt) {
+    if (heap.shouldCollect())
+      collectGarbage();
+    stmt->accept(*this);
+  }
+
+  void collectGarbage() {
+    heap.collect([this](Heap &heap) {
+      heap.mark(result);
+      for (const auto &[name, value] : globals)
+        heap.mark(value);
+      heap.mark(environment.get());
+      for (const auto &frame : frames)
+        heap.mark(frame.get());
+      for (auto value : temporaries)
+        heap.mark(value);
+      heap.mark(returnValue);
+      heap.mark(tailFunction);
+      for (auto value : tailArguments)
+        heap.mark(value);
+    });
+  }
+
+  // A copy of `method` whose closure binds `this` to `receiver`.
+  ObjFunction *bind(ObjFunction *method, Value receiver) {
+    auto frame = std::make_shared<Environment>(method->closure, 1);
+    frame->slots[0] = receiver;
+    return heap.allocate<ObjFunction>(method->declaration, std::move(frame),
+                                      method->isInitializer);
+  }
+
+  bool checkArity(const ObjFunction *function, std::size_t count) {
+    auto arity = function->declaration->params.size();
+    if (count == arity)
+      return true;
+    fail("Expected " + std::to_string(arity) + " arguments but got " +
+         std::to_string(count) + ".");
+    return false;
+  }
+
+  // Calls `function` with the arguments of `expr`, then any functions it
+  // tail-calls. The caller keeps `function` rooted for the duration.
+  Value call(ObjFunction *function, const Call &expr) {
+    if (!checkArity(function, expr.arguments.size()))
+      return Value::nil();
+
+    // The arguments, followed by the function being run, are rooted as
+    // temporaries. Each tail call replaces them.
+    Temporaries roots(*this);
+    auto base = temporaries.size();
+    for (const auto &argument : expr.arguments) {
+      auto value = evaluate(argument.get());
+      if (abrupt())
+        return Value::nil();
+      roots.push(value);
+    }
+    roots.push(Value::object(function));
+
+    if (!function->isInitializer) {
+      std::span<const Value> arguments(temporaries.data() + base,
+                                       expr.arguments.size());
+      if (auto value =
+              jit.run(*function->declaration, arguments, depth, maxDepth))
+        return Value::number(*value);
+    }
+
+    while (true) {
+      const auto &declaration = *function->declaration;
+      {
+        Arena::Scope scope(arena);
+        auto slots = arena.allocate(declaration.frameSize);
+        std::copy_n(temporaries.begin() + static_cast<std::ptrdiff_t>(base),
+                    declaration.params.size(), slots.begin());
+        executeFrame(declaration.body, function->closure, slots,
+                     declaration.captured);
+      }
+
+      Value value = Value::nil();
+      switch (completion) {
+      case Completion::Normal:
+        break;
+      case Completion::Return:
+        completion = Completion::Normal;
+        value = returnValue;
+        break;
+      case Completion::TailCall:
+        completion = Completion::Normal;
+        function = tailFunction;
+        temporaries.resize(base);
+        temporaries.insert(temporaries.end(), tailArguments.begin(),
+                           tailArguments.end());
+        temporaries.push_back(Value::object(function));
+        continue;
+      case Completion::Error:
+        return Value::nil();
+      }
+      // An initializer always returns the instance, bound at slot 0 of its
+      // closure.
+      return function->isInitializer ? function->closure->slots[0] : value;
+    }
+  }
+
+  // Calls whatever `callee` is with the arguments of `expr`. The caller
+  // keeps `callee` rooted.
+  Value invoke(Value callee, const Call &expr) {
+    if (callee.isFunction())
+      return call(callee.asFunction(), expr);
+    if (callee.isClass()) {
+      auto klass = callee.asClass();
+      Temporaries roots(*this);
+      auto instance = heap.instance(klass);
+      roots.push(instance);
+      if (klass->initializer != nullptr) {
+        auto initializer = bind(klass->initializer, instance);
+        roots.push(Value::object(initializer));
+        call(initializer, expr);
+      } else if (!expr.arguments.empty()) {
+        fail("Expected 0 arguments but got " +
+             std::to_string(expr.arguments.size()) + ".");
+      }
+      return instance;
+    }
+    fail("Can only call functions and classes.");
+    return Value::nil();
+  }
+
+  void executeBlock(const std::vector<std::shared_ptr<Statement>> &statements,
+                    std::shared_ptr<Environment> frame) {
+    frames.push_back(std::exchange(environment, std::move(frame)));
+    for (const auto &stmt : statements) {
+      execute(stmt.get());
+      if (abrupt())
+        break;
+    }
+    environment = std::move(frames.back());
+    frames.pop_back();
+  }
+
+  // Runs `statements` in a new frame over `slots`. Only a frame the
+  // Resolver found `captured` is allocated on the heap, where a closure can
+  // keep it; any other lives on the C++ stack for the duration, and the
+  // handle executeBlock gets owns nothing, so entering it makes no heap
+  // allocation at all.
+  void executeFrame(const std::vector<std::shared_ptr<Statement>> &statements,
+                    std::shared_ptr<Environment> enclosing,
+                    std::span<Value> slots, bool captured) {
+    if (captured) {
+      executeBlock(statements, std::make_shared<Environment>(
+                                   std::move(enclosing), slots));
+      return;
+    }
+    Environment frame(std::move(enclosing), slots);
+    executeBlock(statements,
+                 std::shared_ptr<Environment>(std::shared_ptr<Environment>(),
+                                              &frame));
+  }
 
 public:
+  // maxDepth bounds how deeply evaluation may recurse into the tree; deeper
+  // expressions raise a runtime error instead of overflowing the stack. `gc`
+  // paces garbage collection and `jit` compiling hot functions.
+  explicit Interpreter(int maxDepth = 10000, GcPolicy gc = {},
+                       JitPolicy jit = {})
+      : heap(gc), jit(globals, jit), maxDepth(maxDepth) {}
+
+  // Runtime errors are thrown as std::runtime_error.
   LoxValue interpret(Expr *expr) {
-    auto value = expr->accept(*this);
+    depth = 0;
+    auto value = evaluate(expr);
+    throwIfFailed();
+    return toLoxValue(value);
+  }
 
-    try {
-      return std::any_cast<LoxValue>(value);
-    } catch (const std::bad_any_cast &e) {
-      throw std::runtime_error("Interpreter Error: " + std::string(e.what()));
+  // Resolves and runs a program. Resolution errors are reported through
+  // Lox::error and stop the program from running; runtime errors are thrown
+  // as std::runtime_error.
+  void interpret(const std::vector<std::shared_ptr<Statement>> &statements) {
+    Resolver resolver;
+    resolver.resolve(statements);
+    if (Lox::hadError)
+      return;
+    depth = 0;
+    for (const auto &stmt : statements) {
+      execute(stmt.get());
+      if (abrupt())
+        break;
     }
+    throwIfFailed();
   }
 
-  std::any visitLiteral(const Literal &expr) override { return expr.value; }
+  std::any visitLiteral(const Literal &expr) override {
+    if (expr.pool != heap.id) {
+      expr.constant = heap.constant(expr.value);
+      expr.pool = heap.id;
+    }
+    result = expr.constant;
+    return {};
+  }
 
   std::any visitGrouping(const Grouping &expr) override {
-    return evaluate(expr.expression.get());
+    evaluate(expr.expression.get());
+    return {};
   }
 
   std::any visitUnary(const Unary &expr) override {
-    auto right = std::any_cast<LoxValue>(evaluate(expr.right.get()));
+    auto right = evaluate(expr.right.get());
+    if (abrupt())
+      return {};
 
     switch (expr.op.getType()) {
     case TokenType::MINUS:
-      if (std::holds_alternative<double>(right)) {
-        return -std::get<double>(right);
+      if (right.isNumber()) {
+        result = Value::number(-right.asNumber());
+        return {};
       }
-      throw std::runtime_error("Unary minus must be applied to a number");
+      return fail("Unary minus must be applied to a number");
     case TokenType::BANG:
-      if (std::holds_alternative<bool>(right)) {
-        return !std::get<bool>(right);
+      if (right.isBool()) {
+        result = Value::boolean(!right.asBool());
+        return {};
       }
-      throw std::runtime_error("Unary bang must be applied to a boolean");
+      return fail("Unary bang must be applied to a boolean");
     default:
-      throw std::runtime_error("Unknown unary operator");
+      return fail("Unknown unary operator");
     }
   }
 
   std::any visitBinary(const Binary &expr) override {
-    auto left = std::any_cast<LoxValue>(evaluate(expr.left.get()));
-    auto right = std::any_cast<LoxValue>(evaluate(expr.right.get()));
+    Temporaries roots(*this);
+    auto left = evaluate(expr.left.get());
+    if (abrupt())
+      return {};
+    if (left.isObject())
+      roots.push(left);
+    auto right = evaluate(expr.right.get());
+    if (abrupt())
+      return {};
 
-    switch (expr.op.getType()) {
-    case TokenType::MINUS:
-      if (std::holds_alternative<double>(left) &&
-          std::holds_alternative<double>(right)) {
-        return std::get<double>(left) - std::get<double>(right);
-      }
-      throw std::runtime_error("Operands must be numbers");
-    case TokenType::SLASH:
-      if (std::holds_alternative<double>(left) &&
-          std::holds_alternative<double>(right)) {
-        return std::get<double>(left) / std::get<double>(right);
-      }
-      throw std::runtime_error("Operands must be numbers");
-    case TokenType::STAR:
-      if (std::holds_alternative<double>(left) &&
-          std::holds_alternative<double>(right)) {
-        return std::get<double>(left) * std::get<double>(right);
-      }
-      throw std::runtime_error("Operands must be numbers");
-    case TokenType::PLUS:
-      if (std::holds_alternative<double>(left) &&
-          std::holds_alternative<double>(right)) {
-        return std::get<double>(left) + std::get<double>(right);
-      }
-      if (std::holds_alternative<std::string>(left) &&
-          std::holds_alternative<std::string>(right)) {
-        return std::get<std::string>(left) + std::get<std::string>(right);
-      }
-      throw std::runtime_error("Operands must be two numbers or two strings");
-    case TokenType::GREATER:
-      if (std::holds_alternative<double>(left) &&
-          std::holds_alternative<double>(right)) {
-        return std::get<double>(left) > std::get<double>(right);
-      }
-      throw std::runtime_error("Operands must be numbers");
-    case TokenType::GREATER_EQUAL:
-      if (std::holds_alternative<double>(left) &&
-          std::holds_alternative<double>(right)) {
-        return std::get<double>(left) >= std::get<double>(right);
-      }
-      throw std::runtime_error("Operands must be numbers");
-    case TokenType::LESS:
-      if (std::holds_alternative<double>(left) &&
-          std::holds_alternative<double>(right)) {
-        return std::get<double>(left) < std::get<double>(right);
-      }
-      throw std::runtime_error("Operands must be numbers");
-    case TokenType::LESS_EQUAL:
-      if (std::holds_alternative<double>(left) &&
-          std::holds_alternative<double>(right)) {
-        return std::get<double>(left) <= std::get<double>(right);
-      }
-      throw std::runtime_error("Operands must be numbers");
-    case TokenType::BANG_EQUAL:
-      return left != right;
-    case TokenType::EQUAL_EQUAL:
-      return left == right;
-    default:
-      throw std::runtime_error("Unknown binary operator");
+    auto op = expr.op.getType();
+    if (auto message = binaryError(op, left, right))
+      return fail(message);
+    result = binaryHandler(op, left, right)(left, right, heap);
+    return {};
+  }
+
+  std::any visitAssign(const Assign &expr) override {
+    auto value = evaluate(expr.value.get());
+    if (abrupt())
+      return {};
+    auto variable = lookUp(expr.name, expr.resolved);
+    if (variable == nullptr)
+      return {};
+    *variable = value;
+    result = value;
+    return {};
+  }
+
+  std::any visitCall(const Call &expr) override {
+    Temporaries roots(*this);
+    auto callee = evaluate(expr.callee.get());
+    if (abrupt())
+      return {};
+    roots.push(callee);
+    result = invoke(callee, expr);
+    return {};
+  }
+
+  std::any visitGet(const Get &expr) override {
+    auto object = evaluate(expr.object.get());
+    if (abrupt())
+      return {};
+    if (!object.isInstance())
+      return fail("Only instances have properties.");
+    auto instance = object.asInstance();
+    if (auto cached = expr.cache.find(instance->shape, instance->klass->id)) {
+      result = cached->slot >= 0
+                   ? instance->field(cached->slot)
+                   : Value::object(bind(cached->method, object));
+      return {};
     }
+
+    // Fields shadow methods.
+    int slot = instance->shape->slotOf(expr.name.getLexeme());
+    if (slot >= 0) {
+      expr.cache.add({instance->shape, instance->shape, slot});
+      result = instance->field(slot);
+      return {};
+    }
+    auto method = instance->klass->findMethod(expr.name.getLexeme());
+    if (method == nullptr)
+      return fail("Undefined property '" + expr.name.getLexeme() + "'.");
+    expr.cache.add(
+        {instance->shape, instance->shape, -1, instance->klass->id, method});
+    result = Value::object(bind(method, object));
+    return {};
   }
 
-  std::any evaluate(Expr *expr) { return expr->accept(*this); }
+  std::any visitLogical(const Logical &expr) override {
+    auto left = evaluate(expr.left.get());
+    if (abrupt())
+      return {};
+    // `or` stops at a truthy left operand and `and` at a falsey one, which
+    // is then the result; otherwise the result is the right operand.
+    if ((expr.op.getType() == TokenType::OR) != left.isFalsey()) {
+      result = left;
+      return {};
+    }
+    evaluate(expr.right.get());
+    return {};
+  }
+
+  std::any visitSet(const Set &expr) override {
+    auto object = evaluate(expr.object.get());
+    if (abrupt())
+      return {};
+    if (!object.isInstance())
+      return fail("Only instances have fields.");
+    Temporaries roots(*this);
+    roots.push(object);
+    auto value = evaluate(expr.value.get());
+    if (abrupt())
+      return {};
+    auto instance = object.asInstance();
+    auto shape = instance->shape;
+    if (auto cached = expr.cache.find(shape)) {
+      if (cached->transition != shape)
+        instance->transition(cached->transition);
+      instance->field(cached->slot) = value;
+    } else {
+      instance->set(expr.name.getLexeme(), value);
+      expr.cache.add({shape, instance->shape,
+                      instance->shape->slotOf(expr.name.getLexeme())});
+    }
+    result = value;
+    return {};
+  }
+
+  std::any visitSuper(const Super &expr) override {
+    // `this` is bound in the frame just inside the one holding `super`.
+    auto superclass = environment->at(expr.resolved.depth, 0).asClass();
+    auto receiver = environment->at(expr.resolved.depth - 1, 0);
+    auto method = superclass->findMethod(expr.method.getLexeme());
+    if (method == nullptr)
+      return fail("Undefined property '" + expr.method.getLexeme() + "'.");
+    result = Value::object(bind(method, receiver));
+    return {};
+  }
+
+  std::any visitThis(const This &expr) override {
+    result = environment->at(expr.resolved.depth, expr.resolved.slot);
+    return {};
+  }
+
+  std::any visitVariable(const Variable &expr) override {
+    if (auto variable = lookUp(expr.name, expr.resolved))
+      result = *variable;
+    return {};
+  }
+
+  std::any visitBlock(const Block &stmt) override {
+    Arena::Scope scope(arena);
+    executeFrame(stmt.statements, environment, arena.allocate(stmt.frameSize),
+                 stmt.captured);
+    return {};
+  }
+
+  std::any visitClass(const Class &stmt) override {
+    ObjClass *superclass = nullptr;
+    if (stmt.superclass) {
+      auto value = evaluate(stmt.superclass.get());
+      if (abrupt())
+        return {};
+      if (!value.isClass())
+        return fail("Superclass must be a class.");
+      superclass = value.asClass();
+    }
+
+    auto klass = heap.allocate<ObjClass>(stmt.name.getLexeme(), superclass);
+    define(stmt.slot, stmt.name, Value::object(klass));
+
+    // Methods of a subclass close over a frame that binds `super`.
+    Environment::promote(environment.get());
+    auto closure = environment;
+    if (superclass != nullptr) {
+      closure = std::make_shared<Environment>(environment, 1);
+      closure->slots[0] = Value::object(superclass);
+    }
+    for (const auto &method : stmt.methods) {
+      const auto &name = method->name.getLexeme();
+      klass->addMethod(name, heap.allocate<ObjFunction>(method.get(), closure,
+                                                        name == "init"));
+    }
+    return {};
+  }
+
+  std::any visitExpression(const Expression &stmt) override {
+    evaluate(stmt.expression.get());
+    return {};
+  }
+
+  std::any visitFunction(const Function &stmt) override {
+    // The closure may outlive the frames it captures.
+    Environment::promote(environment.get());
+    auto function = heap.allocate<ObjFunction>(&stmt, environment, false);
+    define(stmt.slot, stmt.name, Value::object(function));
+    return {};
+  }
+
+  std::any visitIf(const If &stmt) override {
+    auto condition = evaluate(stmt.condition.get());
+    if (abrupt())
+      return {};
+    if (!condition.isFalsey())
+      execute(stmt.thenBranch.get());
+    else if (stmt.elseBranch)
+      execute(stmt.elseBranch.get());
+    return {};
+  }
+
+  std::any visitPrint(const Print &stmt) override {
+    auto value = evaluate(stmt.expression.get());
+    if (!abrupt())
+      std::cout << to_string(value) << "\n";
+    return {};
+  }
+
+  std::any visitReturn(const Return &stmt) override {
+    if (!stmt.tailCall) {
+      auto value = stmt.value ? evaluate(stmt.value.get()) : Value::nil();
+      if (abrupt())
+        return {};
+      returnValue = value;
+      completion = Completion::Return;
+      return {};
+    }
+
+    const auto &tail = static_cast<const Call &>(*stmt.value);
+    Temporaries roots(*this);
+    auto callee = evaluate(tail.callee.get());
+    if (abrupt())
+      return {};
+    roots.push(callee);
+    if (!callee.isFunction()) {
+      auto value = invoke(callee, tail);
+      if (abrupt())
+        return {};
+      returnValue = value;
+      completion = Completion::Return;
+      return {};
+    }
+
+    auto function = callee.asFunction();
+    if (!checkArity(function, tail.arguments.size()))
+      return {};
+    auto base = temporaries.size();
+    for (const auto &argument : tail.arguments) {
+      auto value = evaluate(argument.get());
+      if (abrupt())
+        return {};
+      roots.push(value);
+    }
+    tailArguments.assign(
+        temporaries.begin() + static_cast<std::ptrdiff_t>(base),
+        temporaries.end());
+    tailFunction = function;
+    completion = Completion::TailCall;
+    return {};
+  }
+
+  std::any visitVar(const Var &stmt) override {
+    auto value = stmt.initializer ? evaluate(stmt.initializer.get())
+                                  : Value::nil();
+    if (!abrupt())
+      define(stmt.slot, stmt.name, value);
+    return {};
+  }
+
+  std::any visitWhile(const While &stmt) override {
+    while (true) {
+      auto condition = evaluate(stmt.condition.get());
+      if (abrupt() || condition.isFalsey())
+        return {};
+      execute(stmt.body.get());
+      if (abrupt())
+        return {};
+    }
+  }
+
+  Value evaluate(const Expr *expr) {
+    if (depth >= maxDepth) {
+      fail("Expression nesting too deep");
+      return Value::nil();
+    }
+    ++depth;
+    expr->accept(*this);
+    --depth;
+    return result;
+  }
 };
 } // namespace Lox
 
@@ -0,0 +1,273 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+#ifndef LOX_IR_H
+#define LOX_IR_H
+
+#include <charconv>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <variant>
+#include <vector>
+
+namespace Lox {
+
+// A mid-level, SSA form representation of one function, lowered from the
+// AST by IrLowering and optimized by IrOptimizer. Every instruction defines at
+// most one value, which is never reassigned; where control flow meets, a
+// Phi at the start of a block picks the value from the predecessor taken.
+// Locals disappear into these values, so the IR only describes what a
+// function does, not the frames the Interpreter keeps.
+enum class IrOp : uint8_t {
+  // Values with no effects. Arithmetic and comparisons fail, as in the
+  // Interpreter, unless their operands are of the right types.
+  Constant,
+  Param,
+  Phi,
+  Copy,
+  // A value proven to be a number, so later uses need no checks.
+  Unbox,
+  Add,
+  Subtract,
+  Multiply,
+  Divide,
+  Greater,
+  GreaterEqual,
+  Less,
+  LessEqual,
+  Equal,
+  NotEqual,
+  Negate,
+  Not,
+  // Values read from, or computed with, the rest of the program.
+  LoadGlobal,
+  LoadOuter,
+  Get,
+  Super,
+  Call,
+  // Effects.
+  StoreGlobal,
+  DefineGlobal,
+  StoreOuter,
+  CheckCall,
+  RequireInstance,
+  SetField,
+  Enter,
+  Fail,
+  Print,
+  // Terminators, which end every block.
+  Jump,
+  Branch,
+  Return,
+  TailCall,
+};
+
+struct IrBlock;
+
+struct IrInstruction {
+  IrOp op;
+  // The value's number, for printing; -1 for instructions with none.
+  int id = -1;
+  std::vector<IrInstruction *> operands;
+  IrBlock *block = nullptr;
+  // Constant: the value, as Literal holds it.
+  std::variant<double, std::string, bool, std::nullptr_t> constant;
+  // The global or property name, the variable a Copy defines, or the
+  // message a Fail reports.
+  std::string name;
+  // Param: the argument's index. Enter and Call: the expression level.
+  // CheckCall: the number of arguments. LoadOuter and StoreOuter: where
+  // the variable is in the closure.
+  int index = 0;
+  int depth = 0;
+  int slot = 0;
+  // Jump: the target. Branch: where a truthy then a falsey condition goes.
+  std::vector<IrBlock *> targets;
+  // Whether the value is always a number, filled in by IrOptimizer.
+  bool number = false;
+  // The source line of the node it was lowered from, or 0 if none. Code
+  // inlined from another function keeps that function's lines.
+  int line = 0;
+
+  explicit IrInstruction(IrOp op) : op(op) {}
+
+  bool isTerminator() const { return op >= IrOp::Jump; }
+
+  bool definesValue() const { return op <= IrOp::Call; }
+};
+
+struct IrBlock {
+  int id;
+  // Phis first, then the body, then one terminator.
+  std::vector<IrInstruction *> instructions;
+  // In the order Phi operands follow.
+  std::vector<IrBlock *> predecessors;
+
+  explicit IrBlock(int id) : id(id) {}
+
+  IrInstruction *terminator() const {
+    return instructions.empty() || !instructions.back()->isTerminator()
+               ? nullptr
+               : instructions.back();
+  }
+
+  const std::vector<IrBlock *> &successors() const {
+    static const std::vector<IrBlock *> none;
+    auto end = terminator();
+    return end ? end->targets : none;
+  }
+};
+
+// A While loop: its condition starts at `header`, whose only predecessor
+// outside the loop is `preheader`.
+struct IrLoop {
+  IrBlock *preheader;
+  IrBlock *header;
+  std::vector<IrBlock *> blocks;
+};
+
+struct IrFunction {
+  std::string name;
+  std::size_t arity = 0;
+  // Whether this is the top level, which runs at a known depth, rather than
+  // a Lox function.
+  bool script = false;
+  // blocks.front() is the entry.
+  std::vector<std::unique_ptr<IrBlock>> blocks;
+  std::vector<std::unique_ptr<IrInstruction>> instructions;
+  std::vector<IrLoop> loops;
+  int values = 0;
+
+  IrBlock *block() {
+    auto id = static_cast<int>(blocks.size());
+    blocks.push_back(std::make_unique<IrBlock>(id));
+    return blocks.back().get();
+  }
+
+  IrInstruction *instruction(IrOp op) {
+    instructions.push_back(std::make_unique<IrInstruction>(op));
+    auto instruction = instructions.back().get();
+    if (instruction->definesValue())
+      instruction->id = values++;
+    return instruction;
+  }
+
+  // Every instruction that uses each value, by IrInstruction::id.
+  std::vector<std::vector<IrInstruction *>> uses() const {
+    std::vector<std::vector<IrInstruction *>> uses(values);
+    for (const auto &block : blocks)
+      for (auto instruction : block->instructions)
+        for (auto operand : instruction->operands)
+          uses[operand->id].push_back(instruction);
+    return uses;
+  }
+};
+
+inline const char *irOpName(IrOp op) {
+  static const char *const names[] = {
+      "const",       "param",        "phi",
+      "copy",        "unbox",        "add",
+      "subtract",    "multiply",     "divide",
+      "greater",     "greater_equal", "less",
+      "less_equal",  "equal",        "not_equal",
+      "negate",      "not",          "load_global",
+      "load_outer",  "get",          "super",
+      "call",        "store_global", "define_global",
+      "store_outer", "check_call",   "require_instance",
+      "set_field",   "enter",        "fail",
+      "print",       "jump",         "branch",
+      "return",      "tail_call"};
+  return names[static_cast<int>(op)];
+}
+
+// Writes `function` in a readable text form, one instruction per line,
+// with the source line each came from.
+inline void dump(const IrFunction &function, std::ostream &out) {
+  auto value = [](const IrInstruction *instruction) {
+    return "v" + std::to_string(instruction->id);
+  };
+  out << "function " << function.name << "(" << function.arity << ")"
+      << (function.script ? " script" : "") << "\n";
+  for (const auto &block : function.blocks) {
+    out << "b" << block->id << ":";
+    if (!block->predecessors.empty()) {
+      out << " ; preds";
+      for (auto predecessor : block->predecessors)
+        out << " b" << predecessor->id;
+    }
+    out << "\n";
+    for (auto instruction : block->instructions) {
+      out << "  ";
+      if (instruction->definesValue())
+        out << value(instruction) << " = ";
+      out << irOpName(instruction->op);
+      std::string separator = " ";
+      auto operand = [&](const std::string &text) {
+        out << separator << text;
+        separator = ", ";
+      };
+      switch (instruction->op) {
+      case IrOp::Constant:
+        std::visit(
+            [&](const auto &constant) {
+              using T = std::decay_t<decltype(constant)>;
+              if constexpr (std::is_same_v<T, double>) {
+                char buffer[32];
+                auto [end, ec] =
+                    std::to_chars(buffer, buffer + sizeof(buffer), constant);
+                operand(std::string(buffer, end));
+              } else if constexpr (std::is_same_v<T, std::string>) {
+                operand(constant);
+              } else if constexpr (std::is_same_v<T, bool>) {
+                operand(constant ? "true" : "false");
+              } else {
+                operand("nil");
+              }
+            },
+            instruction->constant);
+        break;
+      case IrOp::Param:
+      case IrOp::CheckCall:
+      case IrOp::Enter:
+        operand(std::to_string(instruction->index));
+        break;
+      case IrOp::LoadOuter:
+      case IrOp::StoreOuter:
+        operand(std::to_string(instruction->depth) + ":" +
+                std::to_string(instruction->slot));
+        break;
+      default:
+        break;
+      }
+      if (!instruction->name.empty() && instruction->op != IrOp::Copy)
+        operand(instruction->name);
+      for (std::size_t i = 0; i < instruction->operands.size(); ++i) {
+        auto text = value(instruction->operands[i]);
+        if (instruction->op == IrOp::Phi)
+          text = "[" + text + ", b" +
+                 std::to_string(block->predecessors[i]->id) + "]";
+        operand(text);
+      }
+      if (instruction->op == IrOp::Call)
+        operand("level " + std::to_string(instruction->index));
+      for (auto target : instruction->targets)
+        operand("b" + std::to_string(target->id));
+      if (instruction->number)
+        out << " : number";
+      std::string comment = instruction->op == IrOp::Copy ? instruction->name
+                                                          : "";
+      if (instruction->line > 0)
+        comment += (comment.empty() ? "line " : ", line ") +
+                   std::to_string(instruction->line);
+      if (!comment.empty())
+        out << " ; " << comment;
+      out << "\n";
+    }
+  }
+}
+} // namespace Lox
+
+#endif // LOX_IR_H
@@ -0,0 +1,676 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+#ifndef LOX_IRLOWERING_H
+#define LOX_IRLOWERING_H
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Expr.h"
+#include "Ir.h"
+#include "Statement.h"
+
+namespace Lox {
+
+// Lowers a resolved Function, or a top-level expression, to SSA form.
+//
+// Locals become values: the current definition of each is tracked as the
+// body is walked, Phis are placed where If branches meet and at the head
+// of every While loop for each local in scope, and IrOptimizer removes the
+// ones that turn out not to be needed. Frames therefore cannot be
+// captured, and a function declaring a function or class throws
+// Unsupported.
+//
+// The lowered code fails exactly where the Interpreter would: Enter checks
+// the depth of each new expression level, as the Interpreter does on
+// entering each node, and an operation that fails on anything but numbers
+// leaves the local it read marked, with Unbox, as one.
+//
+// Calls to small global functions that are never reassigned are inlined:
+// the callee's body is lowered in place of the Call, its parameters bound
+// to the arguments and its levels offset by the call's, so depth checks and
+// nested calls see the depth the call would have run it at. Recursive
+// callees are not inlined, and each function grows by at most maxGrowth
+// instructions. Inlined instructions keep the callee's source lines.
+class IrLowering : Expr::Visitor, Statement::Visitor {
+public:
+  struct Unsupported {};
+
+private:
+  // A local variable: the Block or Function whose frame holds it, and its
+  // slot there.
+  using Local = std::pair<const void *, int>;
+
+  // A function being inlined: where its returns jump to, with the value
+  // each passes.
+  struct Inline {
+    IrBlock *exit;
+    std::vector<IrInstruction *> values;
+  };
+
+  // The largest callee inlined, and how much inlining may grow a function
+  // by, in IR instructions before optimization.
+  static constexpr std::size_t maxInlineSize = 40;
+  static constexpr std::size_t maxGrowth = 400;
+
+  IrFunction function;
+  IrBlock *current = nullptr;
+  std::map<Local, IrInstruction *> definitions;
+  // Frames of the enclosing scopes within the function, innermost last.
+  std::vector<const void *> scopes;
+  // The value of the expression just lowered.
+  IrInstruction *result = nullptr;
+  // The level of the node being lowered, and the deepest level already
+  // checked, within the current top-level expression. The body being
+  // lowered runs `base` levels deeper than the function's own.
+  int level = 0;
+  int checked = 0;
+  int base = 0;
+  // The source line of the node being lowered.
+  int line = 0;
+  int maxDepth;
+
+  std::unordered_map<std::string, const Function *> functions;
+  // The function lowered, then those being inlined into it, innermost last.
+  std::vector<const Function *> callees;
+  std::vector<Inline> inlines;
+  std::size_t growth = 0;
+  // The sizeOf each function considered for inlining.
+  std::unordered_map<const Function *, std::optional<std::size_t>> sizes;
+
+  IrInstruction *add(IrOp op, std::vector<IrInstruction *> operands = {}) {
+    auto instruction = function.instruction(op);
+    instruction->operands = std::move(operands);
+    instruction->line = line;
+    instruction->block = current;
+    current->instructions.push_back(instruction);
+    return instruction;
+  }
+
+  IrInstruction *
+  constant(std::variant<double, std::string, bool, std::nullptr_t> value) {
+    auto instruction = add(IrOp::Constant);
+    instruction->constant = std::move(value);
+    return instruction;
+  }
+
+  IrInstruction *nil() { return constant(nullptr); }
+
+  void jump(IrBlock *target) {
+    add(IrOp::Jump)->targets = {target};
+    target->predecessors.push_back(current);
+  }
+
+  void fail(const std::string &message) { add(IrOp::Fail)->name = message; }
+
+  // Continues in a block nothing reaches, after a return.
+  void unreachable() { current = function.block(); }
+
+  IrInstruction *phi(IrBlock *block, std::vector<IrInstruction *> operands) {
+    auto phi = function.instruction(IrOp::Phi);
+    phi->operands = std::move(operands);
+    phi->line = line;
+    phi->block = block;
+    auto &instructions = block->instructions;
+    auto end = instructions.begin();
+    while (end != instructions.end() && (*end)->op == IrOp::Phi)
+      ++end;
+    instructions.insert(end, phi);
+    return phi;
+  }
+
+  // The local `resolved` refers to, or null if it lives in the closure.
+  std::optional<Local> local(const Slot &resolved) {
+    auto own = static_cast<int>(scopes.size());
+    if (resolved.depth < 0 || resolved.depth >= own)
+      return std::nullopt;
+    return Local{scopes[own - 1 - resolved.depth], resolved.slot};
+  }
+
+  // A local declared by a branch or loop body that is not a block is only
+  // defined on some paths to where it is used.
+  static IrInstruction *
+  definitionIn(const std::map<Local, IrInstruction *> &definitions,
+               const Local &local) {
+    auto definition = definitions.find(local);
+    if (definition == definitions.end())
+      throw Unsupported{};
+    return definition->second;
+  }
+
+  IrInstruction *loadOuter(const Slot &resolved) {
+    auto load = add(IrOp::LoadOuter);
+    load->depth = resolved.depth - static_cast<int>(scopes.size());
+    load->slot = resolved.slot;
+    return load;
+  }
+
+  void define(const Local &local, IrInstruction *value,
+              const std::string &name) {
+    auto copy = add(IrOp::Copy, {value});
+    copy->name = name;
+    definitions[local] = copy;
+  }
+
+  // Records that `operand`, which produced `value`, found a number there if
+  // it read a local that still holds it.
+  void refine(const Expr *operand, IrInstruction *value) {
+    while (auto grouping = dynamic_cast<const Grouping *>(operand))
+      operand = grouping->expression.get();
+    auto variable = dynamic_cast<const Variable *>(operand);
+    if (variable == nullptr)
+      return;
+    auto read = local(variable->resolved);
+    if (read && definitions[*read] == value)
+      definitions[*read] = add(IrOp::Unbox, {value});
+  }
+
+  // Lowers a node nested one level inside the current one.
+  IrInstruction *lower(const Expr *expr) {
+    ++level;
+    if (level > checked) {
+      checked = level;
+      if (base + level > maxDepth) {
+        // Too deep however shallow the call: this is always an error.
+        fail("Expression nesting too deep");
+        --level;
+        return nil();
+      }
+      if (!function.script)
+        add(IrOp::Enter)->index = base + level;
+    }
+    auto outer = line;
+    expr->accept(*this);
+    line = outer;
+    --level;
+    return result;
+  }
+
+  // Lowers an expression a statement evaluates.
+  IrInstruction *evaluate(const Expr *expr) {
+    level = 0;
+    checked = 0;
+    return lower(expr);
+  }
+
+  void lower(Statement *stmt) {
+    auto outer = line;
+    stmt->accept(*this);
+    line = outer;
+  }
+
+  void lower(const std::vector<std::shared_ptr<Statement>> &statements) {
+    for (const auto &statement : statements)
+      lower(statement.get());
+  }
+
+  // The size of `callee` in IR instructions, or nullopt if it is not to be
+  // inlined: it cannot be lowered, or it refers to itself. Callers that
+  // are inlined into it again are caught by `callees`.
+  std::optional<std::size_t> sizeOf(const Function &callee) {
+    try {
+      auto lowered = IrLowering(maxDepth).lower(callee);
+      for (const auto &instruction : lowered.instructions)
+        if (instruction->op == IrOp::LoadGlobal &&
+            instruction->name == callee.name.getLexeme())
+          return std::nullopt;
+      return lowered.instructions.size();
+    } catch (const Unsupported &) {
+      return std::nullopt;
+    }
+  }
+
+  // The function a call with `count` arguments to `callee` runs, if it is
+  // to be inlined.
+  const Function *inlined(const Expr *callee, std::size_t count) {
+    auto variable = dynamic_cast<const Variable *>(callee);
+    if (variable == nullptr || variable->resolved.depth >= 0)
+      return nullptr;
+    auto found = functions.find(variable->name.getLexeme());
+    if (found == functions.end())
+      return nullptr;
+    auto target = found->second;
+    if (target->params.size() != count ||
+        std::find(callees.begin(), callees.end(), target) != callees.end())
+      return nullptr;
+    auto size = sizes.find(target);
+    if (size == sizes.end())
+      size = sizes.emplace(target, sizeOf(*target)).first;
+    if (!size->second || *size->second > maxInlineSize ||
+        growth + *size->second > maxGrowth)
+      return nullptr;
+    growth += *size->second;
+    return target;
+  }
+
+  // Lowers the body of `callee` in place of a call to it, made `callLevel`
+  // levels deep, and returns the value it returns. Wherever the lookup of
+  // the callee succeeded the global holds it, so the call cannot fail.
+  IrInstruction *inlineCall(const Function &callee,
+                            const std::vector<IrInstruction *> &arguments,
+                            int callLevel) {
+    auto outerScopes = std::move(scopes);
+    auto outerLevel = level;
+    auto outerChecked = checked;
+    auto outerBase = base;
+    auto outerLine = line;
+    base += callLevel;
+    scopes = {&callee};
+    callees.push_back(&callee);
+    inlines.push_back({function.block(), {}});
+    for (std::size_t i = 0; i < arguments.size(); ++i)
+      define({&callee, static_cast<int>(i)}, arguments[i],
+             callee.params[i].getLexeme());
+    lower(callee.body);
+    returnValue(nil());
+
+    auto returned = std::move(inlines.back());
+    inlines.pop_back();
+    callees.pop_back();
+    std::erase_if(definitions, [&](const auto &definition) {
+      return definition.first.first == &callee;
+    });
+    scopes = std::move(outerScopes);
+    level = outerLevel;
+    checked = outerChecked;
+    base = outerBase;
+    line = outerLine;
+    current = returned.exit;
+    return phi(current, std::move(returned.values));
+  }
+
+  void returnValue(IrInstruction *value) {
+    if (inlines.empty()) {
+      add(IrOp::Return, {value});
+    } else {
+      inlines.back().values.push_back(value);
+      jump(inlines.back().exit);
+    }
+    unreachable();
+  }
+
+public:
+  // maxDepth must match the Interpreter's the code is to behave like.
+  // `functions` are the global functions calls may be inlined from, as
+  // Resolver::constantFunctions finds them.
+  explicit IrLowering(
+      int maxDepth = 10000,
+      std::unordered_map<std::string, const Function *> functions = {})
+      : maxDepth(maxDepth), functions(std::move(functions)) {}
+
+  IrFunction lower(const Function &declaration) {
+    function.name = declaration.name.getLexeme();
+    function.arity = declaration.params.size();
+    line = declaration.name.getLine();
+    current = function.block();
+    scopes.push_back(&declaration);
+    callees.push_back(&declaration);
+    for (std::size_t i = 0; i < declaration.params.size(); ++i) {
+      auto param = add(IrOp::Param);
+      param->index = static_cast<int>(i);
+      define({&declaration, static_cast<int>(i)}, param,
+             declaration.params[i].getLexeme());
+    }
+    lower(declaration.body);
+    add(IrOp::Return, {nil()});
+    return std::move(function);
+  }
+
+  // Lowers the top-level expression the `lox` command evaluates.
+  IrFunction lowerScript(const Expr *expr) {
+    function.name = "script";
+    function.script = true;
+    current = function.block();
+    add(IrOp::Return, {evaluate(expr)});
+    return std::move(function);
+  }
+
+  std::any visitLiteral(const Literal &expr) override {
+    result = constant(expr.value);
+    return {};
+  }
+
+  std::any visitGrouping(const Grouping &expr) override {
+    result = lower(expr.expression.get());
+    return {};
+  }
+
+  std::any visitUnary(const Unary &expr) override {
+    line = expr.op.getLine();
+    auto right = lower(expr.right.get());
+    switch (expr.op.getType()) {
+    case TokenType::MINUS:
+      result = add(IrOp::Negate, {right});
+      refine(expr.right.get(), right);
+      break;
+    case TokenType::BANG:
+      result = add(IrOp::Not, {right});
+      break;
+    default:
+      fail("Unknown unary operator");
+      result = nil();
+    }
+    return {};
+  }
+
+  std::any visitBinary(const Binary &expr) override {
+    line = expr.op.getLine();
+    auto left = lower(expr.left.get());
+    auto right = lower(expr.right.get());
+    IrOp op;
+    bool numeric = true;
+    switch (expr.op.getType()) {
+    case TokenType::PLUS:
+      op = IrOp::Add;
+      numeric = false;
+      break;
+    case TokenType::MINUS:
+      op = IrOp::Subtract;
+      break;
+    case TokenType::STAR:
+      op = IrOp::Multiply;
+      break;
+    case TokenType::SLASH:
+      op = IrOp::Divide;
+      break;
+    case TokenType::GREATER:
+      op = IrOp::Greater;
+      break;
+    case TokenType::GREATER_EQUAL:
+      op = IrOp::GreaterEqual;
+      break;
+    case TokenType::LESS:
+      op = IrOp::Less;
+      break;
+    case TokenType::LESS_EQUAL:
+      op = IrOp::LessEqual;
+      break;
+    case TokenType::EQUAL_EQUAL:
+      op = IrOp::Equal;
+      numeric = false;
+      break;
+    case TokenType::BANG_EQUAL:
+      op = IrOp::NotEqual;
+      numeric = false;
+      break;
+    default:
+      fail("Unknown binary operator");
+      result = nil();
+      return {};
+    }
+    result = add(op, {left, right});
+    if (numeric) {
+      refine(expr.left.get(), left);
+      refine(expr.right.get(), right);
+    }
+    return {};
+  }
+
+  std::any visitAssign(const Assign &expr) override {
+    line = expr.name.getLine();
+    auto value = lower(expr.value.get());
+    if (expr.resolved.depth < 0) {
+      add(IrOp::StoreGlobal, {value})->name = expr.name.getLexeme();
+    } else if (auto assigned = local(expr.resolved)) {
+      define(*assigned, value, expr.name.getLexeme());
+    } else {
+      auto store = add(IrOp::StoreOuter, {value});
+      store->depth = expr.resolved.depth - static_cast<int>(scopes.size());
+      store->slot = expr.resolved.slot;
+    }
+    result = value;
+    return {};
+  }
+
+  std::any visitCall(const Call &expr) override {
+    line = expr.paren.getLine();
+    auto callee = lower(expr.callee.get());
+    auto target = inlined(expr.callee.get(), expr.arguments.size());
+    if (target == nullptr)
+      add(IrOp::CheckCall, {callee})->index =
+          static_cast<int>(expr.arguments.size());
+    std::vector<IrInstruction *> operands{callee};
+    for (const auto &argument : expr.arguments)
+      operands.push_back(lower(argument.get()));
+    if (target != nullptr) {
+      operands.erase(operands.begin());
+      result = inlineCall(*target, operands, level);
+      return {};
+    }
+    result = add(IrOp::Call, std::move(operands));
+    result->index = base + level;
+    return {};
+  }
+
+  std::any visitGet(const Get &expr) override {
+    line = expr.name.getLine();
+    result = add(IrOp::Get, {lower(expr.object.get())});
+    result->name = expr.name.getLexeme();
+    return {};
+  }
+
+  std::any visitLogical(const Logical &expr) override {
+    line = expr.op.getLine();
+    auto left = lower(expr.left.get());
+    // `or` stops at a truthy left operand and `and` at a falsey one, and
+    // only otherwise evaluates the right.
+    auto rightBlock = function.block();
+    auto merge = function.block();
+    add(IrOp::Branch, {left})->targets =
+        expr.op.getType() == TokenType::OR
+            ? std::vector<IrBlock *>{merge, rightBlock}
+            : std::vector<IrBlock *>{rightBlock, merge};
+    rightBlock->predecessors.push_back(current);
+    merge->predecessors.push_back(current);
+    auto before = definitions;
+    auto outerChecked = checked;
+
+    current = rightBlock;
+    auto right = lower(expr.right.get());
+    // The checks made within the right operand are skipped with it.
+    checked = outerChecked;
+    jump(merge);
+    current = merge;
+    auto rightDefinitions = std::move(definitions);
+    definitions = std::move(before);
+    for (auto &[local, definition] : definitions) {
+      auto fromRight = definitionIn(rightDefinitions, local);
+      if (fromRight != definition)
+        definition = phi(merge, {definition, fromRight});
+    }
+    result = phi(merge, {left, right});
+    return {};
+  }
+
+  std::any visitSet(const Set &expr) override {
+    line = expr.name.getLine();
+    auto object = lower(expr.object.get());
+    add(IrOp::RequireInstance, {object});
+    auto value = lower(expr.value.get());
+    add(IrOp::SetField, {object, value})->name = expr.name.getLexeme();
+    result = value;
+    return {};
+  }
+
+  std::any visitSuper(const Super &expr) override {
+    line = expr.keyword.getLine();
+    // `this` is bound in the frame just inside the one holding `super`.
+    auto superclass = loadOuter(expr.resolved);
+    auto receiver = loadOuter({expr.resolved.depth - 1, 0});
+    result = add(IrOp::Super, {superclass, receiver});
+    result->name = expr.method.getLexeme();
+    return {};
+  }
+
+  std::any visitThis(const This &expr) override {
+    line = expr.keyword.getLine();
+    result = loadOuter(expr.resolved);
+    return {};
+  }
+
+  std::any visitVariable(const Variable &expr) override {
+    line = expr.name.getLine();
+    if (expr.resolved.depth < 0) {
+      result = add(IrOp::LoadGlobal);
+      result->name = expr.name.getLexeme();
+    } else if (auto read = local(expr.resolved)) {
+      result = definitions.at(*read);
+    } else {
+      result = loadOuter(expr.resolved);
+    }
+    return {};
+  }
+
+  std::any visitBlock(const Block &stmt) override {
+    scopes.push_back(&stmt);
+    lower(stmt.statements);
+    scopes.pop_back();
+    // The block's locals are out of scope, so need no Phis.
+    std::erase_if(definitions, [&](const auto &definition) {
+      return definition.first.first == &stmt;
+    });
+    return {};
+  }
+
+  std::any visitClass(const Class &stmt) override { throw Unsupported{}; }
+
+  std::any visitExpression(const Expression &stmt) override {
+    evaluate(stmt.expression.get());
+    return {};
+  }
+
+  std::any visitFunction(const Function &stmt) override {
+    throw Unsupported{};
+  }
+
+  std::any visitIf(const If &stmt) override {
+    auto condition = evaluate(stmt.condition.get());
+    auto thenBlock = function.block();
+    auto elseBlock = function.block();
+    add(IrOp::Branch, {condition})->targets = {thenBlock, elseBlock};
+    thenBlock->predecessors.push_back(current);
+    elseBlock->predecessors.push_back(current);
+    auto before = definitions;
+
+    current = thenBlock;
+    lower(stmt.thenBranch.get());
+    auto thenEnd = current;
+    auto thenDefinitions = std::move(definitions);
+
+    current = elseBlock;
+    definitions = before;
+    if (stmt.elseBranch)
+      lower(stmt.elseBranch.get());
+    auto elseEnd = current;
+
+    auto merge = function.block();
+    current = thenEnd;
+    jump(merge);
+    current = elseEnd;
+    jump(merge);
+    current = merge;
+    for (auto &[local, definition] : definitions) {
+      auto fromThen = definitionIn(thenDefinitions, local);
+      if (fromThen != definition)
+        definition = phi(merge, {fromThen, definition});
+    }
+    return {};
+  }
+
+  std::any visitPrint(const Print &stmt) override {
+    add(IrOp::Print, {evaluate(stmt.expression.get())});
+    return {};
+  }
+
+  std::any visitReturn(const Return &stmt) override {
+    line = stmt.keyword.getLine();
+    if (!stmt.value) {
+      returnValue(nil());
+      return {};
+    }
+    if (!stmt.tailCall) {
+      returnValue(evaluate(stmt.value.get()));
+      return {};
+    }
+
+    // The call node itself is not evaluated as an expression, and the
+    // callee runs at the depth of the function it replaces.
+    const auto &tail = static_cast<const Call &>(*stmt.value);
+    line = tail.paren.getLine();
+    auto callee = evaluate(tail.callee.get());
+    auto target = inlined(tail.callee.get(), tail.arguments.size());
+    if (target == nullptr)
+      add(IrOp::CheckCall, {callee})->index =
+          static_cast<int>(tail.arguments.size());
+    std::vector<IrInstruction *> operands{callee};
+    for (const auto &argument : tail.arguments)
+      operands.push_back(evaluate(argument.get()));
+    if (target != nullptr) {
+      operands.erase(operands.begin());
+      returnValue(inlineCall(*target, operands, 0));
+    } else if (!inlines.empty()) {
+      // An inlined function has no call of its own to replace.
+      auto call = add(IrOp::Call, std::move(operands));
+      call->index = base;
+      returnValue(call);
+    } else {
+      add(IrOp::TailCall, std::move(operands));
+      unreachable();
+    }
+    return {};
+  }
+
+  std::any visitVar(const Var &stmt) override {
+    line = stmt.name.getLine();
+    auto value = stmt.initializer ? evaluate(stmt.initializer.get()) : nil();
+    if (stmt.slot < 0)
+      add(IrOp::DefineGlobal, {value})->name = stmt.name.getLexeme();
+    else
+      define({scopes.back(), stmt.slot}, value, stmt.name.getLexeme());
+    return {};
+  }
+
+  std::any visitWhile(const While &stmt) override {
+    auto preheader = current;
+    auto header = function.block();
+    jump(header);
+    current = header;
+    for (auto &[local, definition] : definitions)
+      definition = phi(header, {definition});
+    auto phis = definitions;
+
+    auto condition = evaluate(stmt.condition.get());
+    auto branch = add(IrOp::Branch, {condition});
+    auto conditionEnd = current;
+    auto exitDefinitions = definitions;
+    auto body = function.block();
+    body->predecessors.push_back(conditionEnd);
+    current = body;
+    lower(stmt.body.get());
+    jump(header);
+    for (auto &[local, phi] : phis)
+      phi->operands.push_back(definitionIn(definitions, local));
+
+    auto exit = function.block();
+    exit->predecessors.push_back(conditionEnd);
+    branch->targets = {body, exit};
+    IrLoop loop{preheader, header, {}};
+    for (auto id = header->id; id < exit->id; ++id)
+      loop.blocks.push_back(function.blocks[id].get());
+    function.loops.push_back(std::move(loop));
+    current = exit;
+    definitions = std::move(exitDefinitions);
+    return {};
+  }
+};
+} // namespace Lox
+
+#endif // LOX_IRLOWERING_H
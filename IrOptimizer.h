@@ -0,0 +1,463 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+#ifndef LOX_IROPTIMIZER_H
+#define LOX_IROPTIMIZER_H
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Ir.h"
+
+namespace Lox {
+
+// Optimizes an IrFunction in place, keeping everything the program can
+// observe - its output, and which runtime error it stops with, and where.
+//
+// Passes, in the order run() applies them:
+//  - unreachable blocks are removed;
+//  - types: which values are always numbers;
+//  - copy propagation, which also folds Phis whose operands are all one
+//    value and Unbox of what is already a number;
+//  - common subexpression elimination over the dominator tree, which also
+//    drops depth checks a dominating check already made;
+//  - loop-invariant code motion of computations that cannot fail out of
+//    While loops, into the loop's preheader;
+//  - dead code elimination of computations that cannot fail and whose
+//    values are unused.
+class IrOptimizer {
+  IrFunction &function;
+  // The immediate dominator of each block, by IrBlock::id.
+  std::vector<IrBlock *> dominators;
+
+  static bool isArithmetic(IrOp op) {
+    return op == IrOp::Add || op == IrOp::Subtract ||
+           op == IrOp::Multiply || op == IrOp::Divide;
+  }
+
+  static bool isComparison(IrOp op) {
+    return op == IrOp::Greater || op == IrOp::GreaterEqual ||
+           op == IrOp::Less || op == IrOp::LessEqual;
+  }
+
+  // Whether `instruction` computes a value from its operands alone, so
+  // that two with the same operands compute the same value.
+  static bool isPure(const IrInstruction *instruction) {
+    auto op = instruction->op;
+    return op == IrOp::Constant || op == IrOp::Unbox || isArithmetic(op) ||
+           isComparison(op) || op == IrOp::Equal || op == IrOp::NotEqual ||
+           op == IrOp::Negate || op == IrOp::Not;
+  }
+
+  static bool numbers(const IrInstruction *instruction) {
+    for (auto operand : instruction->operands)
+      if (!operand->number)
+        return false;
+    return true;
+  }
+
+  // Whether `instruction` is pure and cannot fail, so it may run where it
+  // did not, or not run where it did.
+  static bool isSafe(const IrInstruction *instruction) {
+    auto op = instruction->op;
+    // Not fails on anything but booleans, and Unbox only holds where the
+    // check that proved it did.
+    if (op == IrOp::Not)
+      return false;
+    if (isArithmetic(op) || isComparison(op) || op == IrOp::Negate ||
+        op == IrOp::Unbox)
+      return numbers(instruction);
+    return isPure(instruction);
+  }
+
+  // Whether removing `instruction` when its value is unused changes nothing.
+  static bool isRemovable(const IrInstruction *instruction) {
+    auto op = instruction->op;
+    return isSafe(instruction) || op == IrOp::Param || op == IrOp::Phi ||
+           op == IrOp::Copy || op == IrOp::Unbox || op == IrOp::LoadOuter;
+  }
+
+  // Replaces every use of each value with the one `replacement` maps it to,
+  // and removes the instructions replaced.
+  void
+  replace(std::unordered_map<IrInstruction *, IrInstruction *> &replacement) {
+    std::function<IrInstruction *(IrInstruction *)> resolve =
+        [&](IrInstruction *value) {
+          auto replaced = replacement.find(value);
+          if (replaced == replacement.end())
+            return value;
+          return replaced->second = resolve(replaced->second);
+        };
+    for (const auto &block : function.blocks) {
+      std::erase_if(block->instructions, [&](IrInstruction *instruction) {
+        return replacement.count(instruction);
+      });
+      for (auto instruction : block->instructions)
+        for (auto &operand : instruction->operands)
+          operand = resolve(operand);
+    }
+  }
+
+  void renumberBlocks() {
+    for (std::size_t i = 0; i < function.blocks.size(); ++i)
+      function.blocks[i]->id = static_cast<int>(i);
+  }
+
+  void removeUnreachable() {
+    std::unordered_set<IrBlock *> reached;
+    std::vector<IrBlock *> work{function.blocks.front().get()};
+    while (!work.empty()) {
+      auto block = work.back();
+      work.pop_back();
+      if (reached.insert(block).second)
+        for (auto successor : block->successors())
+          work.push_back(successor);
+    }
+
+    for (const auto &block : function.blocks) {
+      if (!reached.count(block.get()))
+        continue;
+      auto &predecessors = block->predecessors;
+      for (std::size_t i = predecessors.size(); i-- > 0;) {
+        if (reached.count(predecessors[i]))
+          continue;
+        predecessors.erase(predecessors.begin() + i);
+        for (auto instruction : block->instructions)
+          if (instruction->op == IrOp::Phi)
+            instruction->operands.erase(instruction->operands.begin() + i);
+      }
+    }
+    std::erase_if(function.blocks, [&](const auto &block) {
+      return !reached.count(block.get());
+    });
+    for (auto &loop : function.loops)
+      std::erase_if(loop.blocks,
+                    [&](IrBlock *block) { return !reached.count(block); });
+    std::erase_if(function.loops, [&](const IrLoop &loop) {
+      return !reached.count(loop.header);
+    });
+    renumberBlocks();
+  }
+
+  void inferTypes() {
+    // Every value starts out a number, and is refuted until nothing
+    // changes, so a loop counter is a number if only numbers reach it.
+    for (const auto &block : function.blocks)
+      for (auto instruction : block->instructions)
+        instruction->number = true;
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (const auto &block : function.blocks) {
+        for (auto instruction : block->instructions) {
+          bool number;
+          switch (instruction->op) {
+          case IrOp::Constant:
+            number = std::holds_alternative<double>(instruction->constant);
+            break;
+          case IrOp::Unbox:
+          case IrOp::Subtract:
+          case IrOp::Multiply:
+          case IrOp::Divide:
+          case IrOp::Negate:
+            number = true;
+            break;
+          case IrOp::Phi:
+          case IrOp::Copy:
+          case IrOp::Add:
+            number = numbers(instruction);
+            break;
+          default:
+            number = false;
+          }
+          if (number != instruction->number) {
+            instruction->number = number;
+            changed = true;
+          }
+        }
+      }
+    }
+  }
+
+  // The one value `phi` always takes, if any. An Unbox is the value it
+  // unboxes, so a loop does not rebox a local its body only compared.
+  static IrInstruction *trivialSource(
+      IrInstruction *phi,
+      std::unordered_map<IrInstruction *, IrInstruction *> &replacement) {
+    auto resolve = [&](IrInstruction *value) {
+      while (replacement.count(value))
+        value = replacement[value];
+      return value;
+    };
+    IrInstruction *source = nullptr;
+    IrInstruction *base = nullptr;
+    for (auto operand : phi->operands) {
+      operand = resolve(operand);
+      auto unboxed = operand;
+      while (unboxed->op == IrOp::Unbox)
+        unboxed = resolve(unboxed->operands[0]);
+      if (unboxed == phi)
+        continue;
+      if (base != nullptr && unboxed != base)
+        return nullptr;
+      base = unboxed;
+      source = source == nullptr || source == operand ? operand : base;
+    }
+    return source;
+  }
+
+  void propagateCopies() {
+    std::unordered_map<IrInstruction *, IrInstruction *> replacement;
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (const auto &block : function.blocks) {
+        for (auto instruction : block->instructions) {
+          if (replacement.count(instruction))
+            continue;
+          IrInstruction *source = nullptr;
+          if (instruction->op == IrOp::Copy)
+            source = instruction->operands[0];
+          if (instruction->op == IrOp::Unbox &&
+              instruction->operands[0]->number)
+            source = instruction->operands[0];
+          if (instruction->op == IrOp::Phi)
+            source = trivialSource(instruction, replacement);
+          if (source != nullptr) {
+            replacement[instruction] = source;
+            changed = true;
+          }
+        }
+      }
+    }
+    replace(replacement);
+  }
+
+  std::vector<IrBlock *> reversePostorder() {
+    std::vector<IrBlock *> order;
+    std::unordered_set<IrBlock *> visited;
+    std::function<void(IrBlock *)> visit = [&](IrBlock *block) {
+      if (!visited.insert(block).second)
+        return;
+      for (auto successor : block->successors())
+        visit(successor);
+      order.push_back(block);
+    };
+    visit(function.blocks.front().get());
+    std::reverse(order.begin(), order.end());
+    return order;
+  }
+
+  // Cooper, Harvey and Kennedy's iterative algorithm.
+  void computeDominators() {
+    auto order = reversePostorder();
+    std::vector<int> position(function.blocks.size());
+    for (std::size_t i = 0; i < order.size(); ++i)
+      position[order[i]->id] = static_cast<int>(i);
+    dominators.assign(function.blocks.size(), nullptr);
+    auto entry = order.front();
+    dominators[entry->id] = entry;
+    auto intersect = [&](IrBlock *a, IrBlock *b) {
+      while (a != b) {
+        while (position[a->id] > position[b->id])
+          a = dominators[a->id];
+        while (position[b->id] > position[a->id])
+          b = dominators[b->id];
+      }
+      return a;
+    };
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (auto block : order) {
+        if (block == entry)
+          continue;
+        IrBlock *dominator = nullptr;
+        for (auto predecessor : block->predecessors)
+          if (dominators[predecessor->id] != nullptr)
+            dominator = dominator ? intersect(predecessor, dominator)
+                                  : predecessor;
+        if (dominators[block->id] != dominator) {
+          dominators[block->id] = dominator;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  static std::string key(const IrInstruction *instruction) {
+    std::string key = std::to_string(static_cast<int>(instruction->op));
+    if (instruction->op == IrOp::Constant)
+      std::visit(
+          [&](const auto &constant) {
+            using T = std::decay_t<decltype(constant)>;
+            key += ":" + std::to_string(instruction->constant.index()) + ":";
+            if constexpr (std::is_same_v<T, double>) {
+              // Bitwise, so 0 and -0 stay apart.
+              key += std::string(reinterpret_cast<const char *>(&constant),
+                                 sizeof constant);
+            } else if constexpr (std::is_same_v<T, std::string>) {
+              key += constant;
+            } else if constexpr (std::is_same_v<T, bool>) {
+              key += constant ? "1" : "0";
+            }
+          },
+          instruction->constant);
+    // An Unbox is the value it unboxes: it exists only where that value is a
+    // number, and there an operation on either gives the same result.
+    for (auto operand : instruction->operands) {
+      while (operand->op == IrOp::Unbox)
+        operand = operand->operands[0];
+      key += "," + std::to_string(operand->id);
+    }
+    return key;
+  }
+
+  void eliminateCommonSubexpressions() {
+    computeDominators();
+    std::vector<std::vector<IrBlock *>> children(function.blocks.size());
+    for (const auto &block : function.blocks)
+      if (block.get() != function.blocks.front().get())
+        children[dominators[block->id]->id].push_back(block.get());
+
+    std::unordered_map<IrInstruction *, IrInstruction *> replacement;
+    std::unordered_map<std::string, IrInstruction *> available;
+    // The depth each function body runs at is fixed, so a check succeeds
+    // wherever a deeper one dominating it did.
+    std::function<void(IrBlock *, int)> visit = [&](IrBlock *block,
+                                                    int entered) {
+      std::vector<std::string> added;
+      std::vector<IrInstruction *> redundant;
+      for (auto instruction : block->instructions) {
+        for (auto &operand : instruction->operands)
+          while (replacement.count(operand))
+            operand = replacement[operand];
+        if (instruction->op == IrOp::Enter) {
+          if (instruction->index <= entered)
+            redundant.push_back(instruction);
+          else
+            entered = instruction->index;
+          continue;
+        }
+        if (!isPure(instruction))
+          continue;
+        auto [found, inserted] =
+            available.emplace(key(instruction), instruction);
+        if (inserted) {
+          added.push_back(found->first);
+          continue;
+        }
+        // An Add of unboxed operands is known to give a number where the
+        // same Add of the boxed values may not be, so that one is kept.
+        if (found->second->number || !instruction->number)
+          replacement[instruction] = found->second;
+      }
+      std::erase_if(block->instructions, [&](IrInstruction *instruction) {
+        return std::find(redundant.begin(), redundant.end(), instruction) !=
+               redundant.end();
+      });
+      for (auto child : children[block->id])
+        visit(child, entered);
+      for (const auto &key : added)
+        available.erase(key);
+    };
+    visit(function.blocks.front().get(), 0);
+    replace(replacement);
+  }
+
+  // A depth check followed, with nothing in between that could fail or be
+  // seen, by a deeper one is redundant: the deeper one fails first.
+  void mergeDepthChecks() {
+    for (const auto &block : function.blocks) {
+      auto &instructions = block->instructions;
+      std::vector<IrInstruction *> redundant;
+      for (std::size_t i = 0; i < instructions.size(); ++i) {
+        if (instructions[i]->op != IrOp::Enter)
+          continue;
+        for (auto j = i + 1; j < instructions.size(); ++j) {
+          if (instructions[j]->op == IrOp::Enter) {
+            if (instructions[j]->index >= instructions[i]->index)
+              redundant.push_back(instructions[i]);
+            break;
+          }
+          if (!isSafe(instructions[j]))
+            break;
+        }
+      }
+      std::erase_if(instructions, [&](IrInstruction *instruction) {
+        return std::find(redundant.begin(), redundant.end(), instruction) !=
+               redundant.end();
+      });
+    }
+  }
+
+  // Only computations that cannot fail are hoisted: one that can would
+  // fail before the loop, even if the loop never ran it, or ran output
+  // before it. Moving it would need a copy guarded by the loop condition
+  // and the path to it, so it stays in the loop.
+  void hoistLoopInvariants() {
+    // Inner loops come first, so what leaves one may then leave the next.
+    for (auto &loop : function.loops) {
+      std::unordered_set<IrBlock *> inside(loop.blocks.begin(),
+                                           loop.blocks.end());
+      auto invariant = [&](const IrInstruction *instruction) {
+        for (auto operand : instruction->operands)
+          if (inside.count(operand->block))
+            return false;
+        return true;
+      };
+      auto &preheader = loop.preheader->instructions;
+      for (auto block : loop.blocks) {
+        std::erase_if(block->instructions, [&](IrInstruction *instruction) {
+          if (!isSafe(instruction) || !invariant(instruction))
+            return false;
+          preheader.insert(preheader.end() - 1, instruction);
+          instruction->block = loop.preheader;
+          return true;
+        });
+      }
+    }
+  }
+
+  void eliminateDeadCode() {
+    std::unordered_set<IrInstruction *> live;
+    std::vector<IrInstruction *> work;
+    for (const auto &block : function.blocks)
+      for (auto instruction : block->instructions)
+        if (!isRemovable(instruction))
+          work.push_back(instruction);
+    while (!work.empty()) {
+      auto instruction = work.back();
+      work.pop_back();
+      if (live.insert(instruction).second)
+        for (auto operand : instruction->operands)
+          work.push_back(operand);
+    }
+    for (const auto &block : function.blocks)
+      std::erase_if(block->instructions, [&](IrInstruction *instruction) {
+        return !live.count(instruction);
+      });
+  }
+
+public:
+  explicit IrOptimizer(IrFunction &function) : function(function) {}
+
+  void run() {
+    removeUnreachable();
+    inferTypes();
+    propagateCopies();
+    inferTypes();
+    eliminateCommonSubexpressions();
+    hoistLoopInvariants();
+    eliminateDeadCode();
+    mergeDepthChecks();
+  }
+};
+} // namespace Lox
+
+#endif // LOX_IROPTIMIZER_H
@@ -0,0 +1,759 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+#ifndef LOX_JIT_H
+#define LOX_JIT_H
+
+#include <algorithm>
+#include <any>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "Expr.h"
+#include "Statement.h"
+#include "Value.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define LOX_JIT 1
+#include <sys/mman.h>
+#else
+#define LOX_JIT 0
+#endif
+
+namespace Lox {
+
+// When the Interpreter compiles functions to machine code.
+struct JitPolicy {
+  // Only x86-64 Linux has a code generator, so elsewhere this is ignored.
+  bool enabled = LOX_JIT;
+  // Calls a function receives before it is compiled.
+  unsigned hotThreshold = 64;
+  // Deoptimizations after which a function's code is no longer entered.
+  unsigned maxDeopts = 16;
+};
+
+namespace detail {
+// Machine code copied into its own mapping, which is made executable and no
+// longer writable once the copy is done.
+class ExecutableMemory {
+  void *memory = nullptr;
+  std::size_t size = 0;
+
+public:
+  ExecutableMemory() = default;
+
+  explicit ExecutableMemory(const std::vector<uint8_t> &code) {
+#if LOX_JIT
+    void *mapping = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+      return;
+    std::memcpy(mapping, code.data(), code.size());
+    if (mprotect(mapping, code.size(), PROT_READ | PROT_EXEC) != 0) {
+      munmap(mapping, code.size());
+      return;
+    }
+    memory = mapping;
+    size = code.size();
+#endif
+  }
+
+  ExecutableMemory(ExecutableMemory &&other) noexcept
+      : memory(std::exchange(other.memory, nullptr)),
+        size(std::exchange(other.size, 0)) {}
+
+  ExecutableMemory &operator=(ExecutableMemory &&other) noexcept {
+    std::swap(memory, other.memory);
+    std::swap(size, other.size);
+    return *this;
+  }
+
+  ~ExecutableMemory() {
+#if LOX_JIT
+    if (memory != nullptr)
+      munmap(memory, size);
+#endif
+  }
+
+  // Null if the mapping could not be made.
+  [[nodiscard]] void *data() const { return memory; }
+};
+
+// Encodes the handful of x86-64 instructions the JIT emits. Doubles live in
+// xmm0 and xmm1; memory operands are always [base + disp32].
+class Assembler {
+public:
+  enum Register : uint8_t { RAX = 0, RSP = 4, RBP = 5, RDI = 7 };
+
+  // Condition codes, as the low nibble of the Jcc opcode.
+  enum Condition : uint8_t {
+    Below = 0x2,
+    AboveEqual = 0x3,
+    Equal = 0x4,
+    NotEqual = 0x5,
+    BelowEqual = 0x6,
+    Above = 0x7,
+    Parity = 0xa,
+  };
+
+  // A jump target. Jumps emitted before it is bound are patched by bind().
+  struct Label {
+    std::ptrdiff_t position = -1;
+    std::vector<std::size_t> uses;
+  };
+
+  std::vector<uint8_t> code;
+
+  void bytes(std::initializer_list<uint8_t> values) {
+    code.insert(code.end(), values);
+  }
+
+  void int32(int32_t value) {
+    auto bits = static_cast<uint32_t>(value);
+    for (int i = 0; i < 4; ++i)
+      code.push_back(static_cast<uint8_t>(bits >> (8 * i)));
+  }
+
+  void int64(uint64_t value) {
+    for (int i = 0; i < 8; ++i)
+      code.push_back(static_cast<uint8_t>(value >> (8 * i)));
+  }
+
+  void patch32(std::size_t at, int32_t value) {
+    auto bits = static_cast<uint32_t>(value);
+    for (int i = 0; i < 4; ++i)
+      code[at + i] = static_cast<uint8_t>(bits >> (8 * i));
+  }
+
+  // ModRM, SIB if needed, and displacement for [base + disp].
+  void memory(int reg, Register base, int32_t disp) {
+    code.push_back(static_cast<uint8_t>(0x80 | (reg << 3) | base));
+    if (base == RSP)
+      code.push_back(0x24);
+    int32(disp);
+  }
+
+  // movsd xmm, [base + disp]
+  void loadDouble(int xmm, Register base, int32_t disp) {
+    bytes({0xf2, 0x0f, 0x10});
+    memory(xmm, base, disp);
+  }
+
+  // movsd [base + disp], xmm
+  void storeDouble(Register base, int32_t disp, int xmm) {
+    bytes({0xf2, 0x0f, 0x11});
+    memory(xmm, base, disp);
+  }
+
+  // mov rax, imm64; movq xmm, rax
+  void loadConstant(int xmm, double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof bits);
+    bytes({0x48, 0xb8});
+    int64(bits);
+    bytes({0x66, 0x48, 0x0f, 0x6e, static_cast<uint8_t>(0xc0 | xmm << 3)});
+  }
+
+  // movapd to, from
+  void moveDouble(int to, int from) {
+    bytes({0x66, 0x0f, 0x28, static_cast<uint8_t>(0xc0 | to << 3 | from)});
+  }
+
+  // addsd (0x58), mulsd (0x59), subsd (0x5c) or divsd (0x5e) to, from
+  void arithmetic(uint8_t opcode, int to, int from) {
+    bytes({0xf2, 0x0f, opcode, static_cast<uint8_t>(0xc0 | to << 3 | from)});
+  }
+
+  // xorpd to, from
+  void xorDouble(int to, int from) {
+    bytes({0x66, 0x0f, 0x57, static_cast<uint8_t>(0xc0 | to << 3 | from)});
+  }
+
+  // ucomisd a, b
+  void compareDouble(int a, int b) {
+    bytes({0x66, 0x0f, 0x2e, static_cast<uint8_t>(0xc0 | a << 3 | b)});
+  }
+
+  void jump(Label &label) {
+    bytes({0xe9});
+    link(label);
+  }
+
+  void jumpIf(Condition condition, Label &label) {
+    bytes({0x0f, static_cast<uint8_t>(0x80 | condition)});
+    link(label);
+  }
+
+  void bind(Label &label) {
+    label.position = static_cast<std::ptrdiff_t>(code.size());
+    for (auto use : label.uses)
+      patch32(use, static_cast<int32_t>(label.position -
+                                        static_cast<std::ptrdiff_t>(use + 4)));
+    label.uses.clear();
+  }
+
+  // mov rax, imm64; call rax
+  void call(const void *target) {
+    bytes({0x48, 0xb8});
+    int64(reinterpret_cast<uint64_t>(target));
+    bytes({0xff, 0xd0});
+  }
+
+private:
+  void link(Label &label) {
+    if (label.position >= 0) {
+      int32(static_cast<int32_t>(
+          label.position - static_cast<std::ptrdiff_t>(code.size() + 4)));
+    } else {
+      label.uses.push_back(code.size());
+      int32(0);
+    }
+  }
+};
+} // namespace detail
+
+// A baseline compiler from Lox functions to x86-64 machine code.
+//
+// A function is compiled once it has been called hotThreshold times, if
+// every value it handles is provably a number: its parameters and locals,
+// number literals, arithmetic and negation, comparisons used as If and
+// While conditions, and calls to global functions that compile too. Such a
+// function has no effect but its result, so whenever a guard fails - an
+// argument that is not a number, a callee global rebound to another
+// function, reaching the end without returning a number, or recursing too
+// deep - the code bails out and the Interpreter simply runs the call again
+// from the start. Anything else is left to the Interpreter.
+//
+// The generated code keeps locals as raw doubles in its native stack frame
+// and calls other compiled functions through callSite(), which re-checks
+// the callee's binding on every call. Depth is charged as the Interpreter
+// would charge it, never less, so compiled code gives up wherever the
+// Interpreter could report "Expression nesting too deep".
+class Jit {
+public:
+  // Shared by all the compiled frames of one call from the Interpreter.
+  // `depth` is the Interpreter's expression depth at which the running
+  // function's body is evaluated.
+  struct Context {
+    bool bailout = false;
+    int depth = 0;
+    int maxDepth = 0;
+  };
+
+  using Code = double (*)(const double *arguments, Context *context);
+
+private:
+  // Thrown while generating code for a function that can't be compiled.
+  struct Unsupported {};
+
+  struct Entry {
+    enum class State { Cold, Compiling, Compiled, Rejected };
+    State state = State::Cold;
+    unsigned calls = 0;
+    unsigned deopts = 0;
+    // The deepest expression nesting in the body.
+    int nesting = 0;
+    detail::ExecutableMemory memory;
+    // Null until compiled, and again once the function deoptimizes too
+    // often.
+    Code code = nullptr;
+  };
+
+  // A call from compiled code to the function bound to a global, made at
+  // `nesting` levels of expression inside the caller's body.
+  struct Site {
+    const Value *binding;
+    const Function *callee;
+    const Entry *entry;
+    int nesting;
+  };
+
+  class CodeGenerator;
+
+  JitPolicy policy;
+  const std::unordered_map<std::string, Value> &globals;
+  // Keyed by declaration: compiled code reads nothing from a closure, so
+  // every function made from one declaration shares it.
+  std::unordered_map<const Function *, Entry> entries;
+  std::vector<std::unique_ptr<Site>> sites;
+  std::vector<double> arguments;
+
+  static double callSite(Context *context, const Site *site,
+                         const double *arguments) noexcept {
+    auto callee = *site->binding;
+    auto depth = context->depth + site->nesting;
+    if (!callee.isFunction() ||
+        callee.asFunction()->declaration != site->callee ||
+        site->entry->code == nullptr ||
+        depth + site->entry->nesting > context->maxDepth) {
+      context->bailout = true;
+      return 0;
+    }
+    auto caller = std::exchange(context->depth, depth);
+    auto result = site->entry->code(arguments, context);
+    context->depth = caller;
+    return result;
+  }
+
+  bool compile(const Function &declaration);
+
+public:
+  Jit(const std::unordered_map<std::string, Value> &globals, JitPolicy policy)
+      : policy(policy), globals(globals) {
+    this->policy.enabled = this->policy.enabled && LOX_JIT;
+  }
+  Jit(const Jit &) = delete;
+  Jit &operator=(const Jit &) = delete;
+
+  // Runs a call to `declaration` whose body the Interpreter would evaluate
+  // at expression depth `depth`, as machine code if it is hot and compiles.
+  // Returns nullopt when the Interpreter has to run the call instead.
+  std::optional<double> run(const Function &declaration,
+                            std::span<const Value> values, int depth,
+                            int maxDepth) {
+    if (!policy.enabled)
+      return std::nullopt;
+    auto &entry = entries[&declaration];
+    if (entry.state == Entry::State::Cold &&
+        ++entry.calls >= policy.hotThreshold)
+      compile(declaration);
+    if (entry.code == nullptr || depth + entry.nesting > maxDepth)
+      return std::nullopt;
+
+    arguments.clear();
+    for (auto value : values) {
+      if (!value.isNumber())
+        return std::nullopt;
+      arguments.push_back(value.asNumber());
+    }
+    Context context{false, depth, maxDepth};
+    auto result = entry.code(arguments.data(), &context);
+    if (!context.bailout)
+      return result;
+    if (++entry.deopts >= policy.maxDeopts)
+      entry.code = nullptr;
+    return std::nullopt;
+  }
+};
+
+// Emits one function. Values are computed into xmm0; a binary operator
+// holds its left operand in a temporary slot while the right one is
+// computed, unless the right one can be loaded straight into xmm1.
+//
+// `level` tracks how many expressions the Interpreter would be evaluating
+// at the point being emitted, to find each call's and the body's nesting.
+//
+// Frame layout, below the saved rbp and r12 (which holds the Context):
+// locals at [rbp - 16 - 8 * i], then temporaries and outgoing arguments at
+// [rsp + 8 * i].
+class Jit::CodeGenerator : Expr::Visitor, Statement::Visitor {
+  using Assembler = detail::Assembler;
+
+  Jit &jit;
+  const Function &function;
+  Assembler assembler;
+  Assembler::Label exit;
+  // First local slot of each enclosing scope, innermost last.
+  std::vector<int> scopes;
+  int locals = 0;
+  int temporaries = 0;
+  int maxTemporaries = 0;
+  int level = 0;
+  int maxLevel = 0;
+
+  static int32_t localOffset(int index) { return -16 - 8 * index; }
+  static int32_t temporaryOffset(int index) { return 8 * index; }
+
+  // Strips parentheses from an expression evaluated one level down, noting
+  // the levels they occupy.
+  const Expr *unwrap(const Expr *expr) {
+    int levels = level + 1;
+    while (auto grouping = dynamic_cast<const Grouping *>(expr)) {
+      expr = grouping->expression.get();
+      ++levels;
+    }
+    maxLevel = std::max(maxLevel, levels);
+    return expr;
+  }
+
+  // The local slot of a variable of this function, which can't be a global
+  // or belong to an enclosing function.
+  int local(const Slot &resolved) const {
+    if (resolved.depth < 0 ||
+        resolved.depth >= static_cast<int>(scopes.size()))
+      throw Unsupported{};
+    return scopes[scopes.size() - 1 - resolved.depth] + resolved.slot;
+  }
+
+  int reserveTemporaries(int count) {
+    int first = temporaries;
+    temporaries += count;
+    maxTemporaries = std::max(maxTemporaries, temporaries);
+    return first;
+  }
+
+  void bailOut() {
+    // mov byte [r12], 1
+    assembler.bytes({0x41, 0xc6, 0x04, 0x24, 0x01});
+    assembler.jump(exit);
+  }
+
+  void emit(const Expr *expr) {
+    maxLevel = std::max(maxLevel, ++level);
+    expr->accept(*this);
+    --level;
+  }
+
+  void emit(Statement *stmt) { stmt->accept(*this); }
+
+  // Loads a number literal or local into `xmm` without using xmm0, if
+  // `expr` is one.
+  bool emitOperand(int xmm, const Expr *expr) {
+    expr = unwrap(expr);
+    if (auto literal = dynamic_cast<const Literal *>(expr)) {
+      if (!std::holds_alternative<double>(literal->value))
+        throw Unsupported{};
+      assembler.loadConstant(xmm, std::get<double>(literal->value));
+      return true;
+    }
+    if (auto variable = dynamic_cast<const Variable *>(expr)) {
+      assembler.loadDouble(xmm, Assembler::RBP,
+                           localOffset(local(variable->resolved)));
+      return true;
+    }
+    return false;
+  }
+
+  // Leaves the left operand in xmm0 and the right one in xmm1.
+  void emitOperands(const Binary &expr) {
+    emit(expr.left.get());
+    if (emitOperand(1, expr.right.get()))
+      return;
+    int slot = reserveTemporaries(1);
+    assembler.storeDouble(Assembler::RSP, temporaryOffset(slot), 0);
+    emit(expr.right.get());
+    assembler.moveDouble(1, 0);
+    assembler.loadDouble(0, Assembler::RSP, temporaryOffset(slot));
+    temporaries = slot;
+  }
+
+  // Jumps to `target` if `condition` evaluates to `sense`.
+  void branch(const Expr *condition, bool sense, Assembler::Label &target) {
+    maxLevel = std::max(maxLevel, ++level);
+    branchOn(condition, sense, target);
+    --level;
+  }
+
+  void branchOn(const Expr *condition, bool sense, Assembler::Label &target) {
+    if (auto grouping = dynamic_cast<const Grouping *>(condition)) {
+      branch(grouping->expression.get(), sense, target);
+      return;
+    }
+    if (auto literal = dynamic_cast<const Literal *>(condition)) {
+      if (!std::holds_alternative<bool>(literal->value))
+        throw Unsupported{};
+      if (std::get<bool>(literal->value) == sense)
+        assembler.jump(target);
+      return;
+    }
+    if (auto unary = dynamic_cast<const Unary *>(condition)) {
+      if (unary->op.getType() != TokenType::BANG)
+        throw Unsupported{};
+      branch(unary->right.get(), !sense, target);
+      return;
+    }
+    auto binary = dynamic_cast<const Binary *>(condition);
+    if (binary == nullptr)
+      throw Unsupported{};
+
+    // ucomisd leaves ZF, PF and CF all set for NaN operands, which must
+    // compare false under every operator but !=.
+    auto op = binary->op.getType();
+    auto swapped = op == TokenType::LESS || op == TokenType::LESS_EQUAL;
+    switch (op) {
+    case TokenType::GREATER:
+    case TokenType::GREATER_EQUAL:
+    case TokenType::LESS:
+    case TokenType::LESS_EQUAL:
+    case TokenType::EQUAL_EQUAL:
+    case TokenType::BANG_EQUAL:
+      break;
+    default:
+      throw Unsupported{};
+    }
+    emitOperands(*binary);
+    if (swapped)
+      assembler.compareDouble(1, 0);
+    else
+      assembler.compareDouble(0, 1);
+
+    auto strict = op == TokenType::GREATER || op == TokenType::LESS;
+    if (op != TokenType::EQUAL_EQUAL && op != TokenType::BANG_EQUAL) {
+      if (sense)
+        assembler.jumpIf(strict ? Assembler::Above : Assembler::AboveEqual,
+                         target);
+      else
+        assembler.jumpIf(strict ? Assembler::BelowEqual : Assembler::Below,
+                         target);
+      return;
+    }
+    if (sense == (op == TokenType::EQUAL_EQUAL)) {
+      // Equal and ordered.
+      Assembler::Label unordered;
+      assembler.jumpIf(Assembler::Parity, unordered);
+      assembler.jumpIf(Assembler::Equal, target);
+      assembler.bind(unordered);
+    } else {
+      assembler.jumpIf(Assembler::NotEqual, target);
+      assembler.jumpIf(Assembler::Parity, target);
+    }
+  }
+
+public:
+  CodeGenerator(Jit &jit, const Function &function)
+      : jit(jit), function(function) {}
+
+  // The deepest expression nesting in the body; valid after generate().
+  [[nodiscard]] int nesting() const { return maxLevel; }
+
+  // The finished code, or throws Unsupported.
+  std::vector<uint8_t> generate() {
+    auto params = static_cast<int>(function.params.size());
+    // push rbp; mov rbp, rsp; push r12; sub rsp, frame; mov r12, rsi
+    assembler.bytes({0x55, 0x48, 0x89, 0xe5, 0x41, 0x54, 0x48, 0x81, 0xec});
+    auto frameSize = assembler.code.size();
+    assembler.int32(0);
+    assembler.bytes({0x49, 0x89, 0xf4});
+    for (int i = 0; i < params; ++i) {
+      assembler.loadDouble(0, Assembler::RDI, 8 * i);
+      assembler.storeDouble(Assembler::RBP, localOffset(i), 0);
+    }
+
+    scopes.push_back(0);
+    locals = function.frameSize;
+    for (const auto &stmt : function.body)
+      emit(stmt.get());
+    // Falling off the end returns nil.
+    bailOut();
+
+    assembler.bind(exit);
+    // mov r12, [rbp - 8]; mov rsp, rbp; pop rbp; ret
+    assembler.bytes({0x4c, 0x8b, 0x65, 0xf8, 0x48, 0x89, 0xec, 0x5d, 0xc3});
+
+    // Keep rsp 16-byte aligned at calls: it is 8 off after the two pushes.
+    int32_t frame = 8 * (locals + maxTemporaries);
+    if (frame % 16 == 0)
+      frame += 8;
+    assembler.patch32(frameSize, frame);
+    return std::move(assembler.code);
+  }
+
+  std::any visitLiteral(const Literal &expr) override {
+    if (!std::holds_alternative<double>(expr.value))
+      throw Unsupported{};
+    assembler.loadConstant(0, std::get<double>(expr.value));
+    return {};
+  }
+
+  std::any visitGrouping(const Grouping &expr) override {
+    emit(expr.expression.get());
+    return {};
+  }
+
+  std::any visitUnary(const Unary &expr) override {
+    if (expr.op.getType() != TokenType::MINUS)
+      throw Unsupported{};
+    emit(expr.right.get());
+    assembler.loadConstant(1, -0.0);
+    assembler.xorDouble(0, 1);
+    return {};
+  }
+
+  std::any visitBinary(const Binary &expr) override {
+    uint8_t opcode;
+    switch (expr.op.getType()) {
+    case TokenType::PLUS:
+      opcode = 0x58;
+      break;
+    case TokenType::STAR:
+      opcode = 0x59;
+      break;
+    case TokenType::MINUS:
+      opcode = 0x5c;
+      break;
+    case TokenType::SLASH:
+      opcode = 0x5e;
+      break;
+    default:
+      throw Unsupported{};
+    }
+    emitOperands(expr);
+    assembler.arithmetic(opcode, 0, 1);
+    return {};
+  }
+
+  std::any visitAssign(const Assign &expr) override {
+    auto slot = local(expr.resolved);
+    emit(expr.value.get());
+    assembler.storeDouble(Assembler::RBP, localOffset(slot), 0);
+    return {};
+  }
+
+  std::any visitCall(const Call &expr) override {
+    auto variable = dynamic_cast<const Variable *>(unwrap(expr.callee.get()));
+    if (variable == nullptr || variable->resolved.depth >= 0)
+      throw Unsupported{};
+    auto found = jit.globals.find(variable->name.getLexeme());
+    if (found == jit.globals.end() || !found->second.isFunction())
+      throw Unsupported{};
+    auto callee = found->second.asFunction();
+    if (callee->isInitializer ||
+        callee->declaration->params.size() != expr.arguments.size())
+      throw Unsupported{};
+    auto &entry = jit.entries[callee->declaration];
+    if (entry.state == Entry::State::Cold)
+      jit.compile(*callee->declaration);
+    if (entry.state == Entry::State::Rejected)
+      throw Unsupported{};
+    // Taken now, as calls among the arguments add sites of their own.
+    auto site = jit.sites
+                    .emplace_back(std::make_unique<Site>(Site{
+                        &found->second, callee->declaration, &entry, level}))
+                    .get();
+
+    auto count = static_cast<int>(expr.arguments.size());
+    int first = reserveTemporaries(count);
+    for (int i = 0; i < count; ++i) {
+      emit(expr.arguments[i].get());
+      assembler.storeDouble(Assembler::RSP, temporaryOffset(first + i), 0);
+    }
+    // mov rdi, r12; mov rsi, site; lea rdx, [rsp + arguments]
+    assembler.bytes({0x4c, 0x89, 0xe7, 0x48, 0xbe});
+    assembler.int64(reinterpret_cast<uint64_t>(site));
+    assembler.bytes({0x48, 0x8d, 0x94, 0x24});
+    assembler.int32(temporaryOffset(first));
+    assembler.call(reinterpret_cast<const void *>(&Jit::callSite));
+    // cmp byte [r12], 0; jne exit
+    assembler.bytes({0x41, 0x80, 0x3c, 0x24, 0x00});
+    assembler.jumpIf(Assembler::NotEqual, exit);
+    temporaries = first;
+    return {};
+  }
+
+  std::any visitVariable(const Variable &expr) override {
+    assembler.loadDouble(0, Assembler::RBP, localOffset(local(expr.resolved)));
+    return {};
+  }
+
+  std::any visitGet(const Get &expr) override { throw Unsupported{}; }
+
+  std::any visitLogical(const Logical &expr) override { throw Unsupported{}; }
+
+  std::any visitSet(const Set &expr) override { throw Unsupported{}; }
+
+  std::any visitSuper(const Super &expr) override { throw Unsupported{}; }
+
+  std::any visitThis(const This &expr) override { throw Unsupported{}; }
+
+  std::any visitBlock(const Block &stmt) override {
+    scopes.push_back(locals);
+    locals += stmt.frameSize;
+    for (const auto &statement : stmt.statements)
+      emit(statement.get());
+    scopes.pop_back();
+    return {};
+  }
+
+  std::any visitClass(const Class &stmt) override { throw Unsupported{}; }
+
+  std::any visitExpression(const Expression &stmt) override {
+    emit(stmt.expression.get());
+    return {};
+  }
+
+  std::any visitFunction(const Function &stmt) override {
+    throw Unsupported{};
+  }
+
+  std::any visitIf(const If &stmt) override {
+    Assembler::Label otherwise;
+    branch(stmt.condition.get(), false, otherwise);
+    emit(stmt.thenBranch.get());
+    if (stmt.elseBranch) {
+      Assembler::Label end;
+      assembler.jump(end);
+      assembler.bind(otherwise);
+      emit(stmt.elseBranch.get());
+      assembler.bind(end);
+    } else {
+      assembler.bind(otherwise);
+    }
+    return {};
+  }
+
+  std::any visitPrint(const Print &stmt) override { throw Unsupported{}; }
+
+  std::any visitReturn(const Return &stmt) override {
+    if (!stmt.value) {
+      bailOut();
+      return {};
+    }
+    emit(stmt.value.get());
+    assembler.jump(exit);
+    return {};
+  }
+
+  std::any visitVar(const Var &stmt) override {
+    if (!stmt.initializer || stmt.slot < 0)
+      throw Unsupported{};
+    emit(stmt.initializer.get());
+    assembler.storeDouble(Assembler::RBP,
+                          localOffset(scopes.back() + stmt.slot), 0);
+    return {};
+  }
+
+  std::any visitWhile(const While &stmt) override {
+    Assembler::Label top;
+    Assembler::Label end;
+    assembler.bind(top);
+    branch(stmt.condition.get(), false, end);
+    emit(stmt.body.get());
+    assembler.jump(top);
+    assembler.bind(end);
+    return {};
+  }
+};
+
+inline bool Jit::compile(const Function &declaration) {
+  auto &entry = entries[&declaration];
+  entry.state = Entry::State::Compiling;
+  try {
+    CodeGenerator generator(*this, declaration);
+    entry.memory = detail::ExecutableMemory(generator.generate());
+    entry.nesting = generator.nesting();
+  } catch (const Unsupported &) {
+    entry.state = Entry::State::Rejected;
+    return false;
+  }
+  if (entry.memory.data() == nullptr) {
+    entry.state = Entry::State::Rejected;
+    return false;
+  }
+  entry.code = reinterpret_cast<Code>(entry.memory.data());
+  entry.state = Entry::State::Compiled;
+  return true;
+}
+} // namespace Lox
+
+#endif // LOX_JIT_H
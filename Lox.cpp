@@ -7,6 +7,7 @@
 #include "Lox.h"
 
 bool Lox::Lox::hadError = false;
+bool Lox::Lox::hadRuntimeError = false;
 
 void Lox::Lox::error(int line, const char *message) {
   report(line, "", message);
@@ -17,3 +18,8 @@ void Lox::Lox::report(int line, const char *where, const char *message) {
   std::cerr << "[line " << line << "] Error" << where << ": " << message
             << std::endl;
 }
+
+void Lox::Lox::runtimeError(const char *message) {
+  std::cerr << "Runtime error: " << message << std::endl;
+  hadRuntimeError = true;
+}
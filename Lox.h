@@ -8,8 +8,10 @@
 namespace Lox {
 struct Lox {
   static bool hadError;
+  static bool hadRuntimeError;
   static void error(int line, const char *message);
   static void report(int line, const char *where, const char *message);
+  static void runtimeError(const char *message);
 };
 } // namespace Lox
 
@@ -5,10 +5,12 @@
 #ifndef LOX_PARSER_H
 #define LOX_PARSER_H
 
+#include <string>
 #include <vector>
 
 #include "Expr.h"
 #include "Lox.h"
+#include "Statement.h"
 #include "Token.h"
 
 namespace Lox {
@@ -19,17 +21,237 @@ struct ParserError : public std::exception {
 };
 
 class Parser {
+  // Past this recursion depth expressions are parsed by
+  // iterativeExpression(), which keeps its state on the heap.
+  static constexpr int recursionLimit = 128;
+  static constexpr size_t maxArguments = 255;
+
   std::vector<Token> tokens;
   int current = 0;
+  int depth = 0;
+  int maxDepth;
+  bool repl = false;
+
+  std::shared_ptr<Statement> declaration() {
+    try {
+      if (match({TokenType::CLASS}))
+        return classDeclaration();
+      if (match({TokenType::FUN}))
+        return function("function");
+      if (match({TokenType::VAR}))
+        return varDeclaration();
+      return statement();
+    } catch (const ParserError &) {
+      depth = 0;
+      synchronize();
+      return nullptr;
+    }
+  }
+
+  std::shared_ptr<Statement> classDeclaration() {
+    auto name = consume(TokenType::IDENTIFIER, "Expect class name.");
+    std::shared_ptr<Variable> superclass;
+    if (match({TokenType::LESS})) {
+      consume(TokenType::IDENTIFIER, "Expect superclass name.");
+      superclass = std::make_shared<Variable>(previous());
+    }
+    consume(TokenType::LEFT_BRACE, "Expect '{' before class body.");
+    std::vector<std::shared_ptr<Function>> methods;
+    while (!check(TokenType::RIGHT_BRACE) && !isAtEnd())
+      methods.push_back(function("method"));
+    consume(TokenType::RIGHT_BRACE, "Expect '}' after class body.");
+    return std::make_shared<Class>(name, superclass, methods);
+  }
+
+  // `kind` is "function" or "method", for error messages.
+  std::shared_ptr<Function> function(const std::string &kind) {
+    auto name = consume(TokenType::IDENTIFIER, "Expect " + kind + " name.");
+    consume(TokenType::LEFT_PAREN, "Expect '(' after " + kind + " name.");
+    std::vector<Token> params;
+    if (!check(TokenType::RIGHT_PAREN)) {
+      do {
+        if (params.size() >= maxArguments)
+          error(peek(), "Can't have more than 255 parameters.");
+        params.push_back(
+            consume(TokenType::IDENTIFIER, "Expect parameter name."));
+      } while (match({TokenType::COMMA}));
+    }
+    consume(TokenType::RIGHT_PAREN, "Expect ')' after parameters.");
+    consume(TokenType::LEFT_BRACE, "Expect '{' before " + kind + " body.");
+    auto body = block();
+    return std::make_shared<Function>(name, params, body);
+  }
+
+  std::shared_ptr<Statement> varDeclaration() {
+    auto name = consume(TokenType::IDENTIFIER, "Expect variable name.");
+    std::shared_ptr<Expr> initializer;
+    if (match({TokenType::EQUAL}))
+      initializer = expression();
+    consume(TokenType::SEMICOLON, "Expect ';' after variable declaration.");
+    return std::make_shared<Var>(name, initializer);
+  }
+
+  std::shared_ptr<Statement> statement() {
+    if (match({TokenType::FOR}))
+      return forStatement();
+    if (match({TokenType::IF}))
+      return ifStatement();
+    if (match({TokenType::PRINT}))
+      return printStatement();
+    if (match({TokenType::RETURN}))
+      return returnStatement();
+    if (match({TokenType::WHILE}))
+      return whileStatement();
+    if (match({TokenType::LEFT_BRACE}))
+      return std::make_shared<Block>(block());
+    return expressionStatement();
+  }
+
+  // A for loop has no node of its own: it is desugared into a while loop,
+  // wrapped in blocks for its initializer and increment.
+  std::shared_ptr<Statement> forStatement() {
+    consume(TokenType::LEFT_PAREN, "Expect '(' after 'for'.");
+    std::shared_ptr<Statement> initializer;
+    if (match({TokenType::SEMICOLON}))
+      initializer = nullptr;
+    else if (match({TokenType::VAR}))
+      initializer = varDeclaration();
+    else
+      initializer = expressionStatement();
+
+    std::shared_ptr<Expr> condition;
+    if (!check(TokenType::SEMICOLON))
+      condition = expression();
+    consume(TokenType::SEMICOLON, "Expect ';' after loop condition.");
 
-  std::shared_ptr<Expr> expression() { return equality(); }
+    std::shared_ptr<Expr> increment;
+    if (!check(TokenType::RIGHT_PAREN))
+      increment = expression();
+    consume(TokenType::RIGHT_PAREN, "Expect ')' after for clauses.");
+
+    auto body = statement();
+    if (increment)
+      body = std::make_shared<Block>(std::vector<std::shared_ptr<Statement>>{
+          body, std::make_shared<Expression>(increment)});
+    if (!condition)
+      condition = std::make_shared<Literal>(true);
+    body = std::make_shared<While>(condition, body);
+    if (initializer)
+      body = std::make_shared<Block>(
+          std::vector<std::shared_ptr<Statement>>{initializer, body});
+    return body;
+  }
+
+  std::shared_ptr<Statement> ifStatement() {
+    consume(TokenType::LEFT_PAREN, "Expect '(' after 'if'.");
+    auto condition = expression();
+    consume(TokenType::RIGHT_PAREN, "Expect ')' after if condition.");
+    auto thenBranch = statement();
+    std::shared_ptr<Statement> elseBranch;
+    if (match({TokenType::ELSE}))
+      elseBranch = statement();
+    return std::make_shared<If>(condition, thenBranch, elseBranch);
+  }
+
+  std::shared_ptr<Statement> printStatement() {
+    auto value = expression();
+    consume(TokenType::SEMICOLON, "Expect ';' after value.");
+    return std::make_shared<Print>(value);
+  }
+
+  std::shared_ptr<Statement> returnStatement() {
+    auto keyword = previous();
+    std::shared_ptr<Expr> value;
+    if (!check(TokenType::SEMICOLON))
+      value = expression();
+    consume(TokenType::SEMICOLON, "Expect ';' after return value.");
+    return std::make_shared<Return>(keyword, value);
+  }
+
+  std::shared_ptr<Statement> whileStatement() {
+    consume(TokenType::LEFT_PAREN, "Expect '(' after 'while'.");
+    auto condition = expression();
+    consume(TokenType::RIGHT_PAREN, "Expect ')' after condition.");
+    auto body = statement();
+    return std::make_shared<While>(condition, body);
+  }
+
+  std::vector<std::shared_ptr<Statement>> block() {
+    std::vector<std::shared_ptr<Statement>> statements;
+    while (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
+      if (auto statement = declaration())
+        statements.push_back(statement);
+    }
+    consume(TokenType::RIGHT_BRACE, "Expect '}' after block.");
+    return statements;
+  }
+
+  std::shared_ptr<Statement> expressionStatement() {
+    auto expr = expression();
+    // At the prompt a trailing expression needs no ';' and is printed.
+    if (repl && isAtEnd())
+      return std::make_shared<Print>(expr);
+    consume(TokenType::SEMICOLON, "Expect ';' after expression.");
+    return std::make_shared<Expression>(expr);
+  }
+
+  std::shared_ptr<Expr> expression() {
+    if (depth >= recursionLimit)
+      return iterativeExpression();
+    return assignment();
+  }
+
+  std::shared_ptr<Expr> assignment() {
+    auto expr = logicalOr();
+    if (match({TokenType::EQUAL})) {
+      auto equals = previous();
+      enterNesting();
+      auto value = assignment();
+      leaveNesting();
+      return assignmentTo(expr, equals, value);
+    }
+    return expr;
+  }
+
+  // The node for `target = value`. Only variables and properties can be
+  // assigned; anything else is reported, without unwinding the parse.
+  std::shared_ptr<Expr> assignmentTo(std::shared_ptr<Expr> target,
+                                     const Token &equals,
+                                     std::shared_ptr<Expr> value) {
+    if (auto variable = std::dynamic_pointer_cast<Variable>(target))
+      return node<Assign>(equals, variable->name, value);
+    if (auto get = std::dynamic_pointer_cast<Get>(target))
+      return node<Set>(equals, get->object, get->name, value);
+    error(equals, "Invalid assignment target.");
+    return target;
+  }
+
+  std::shared_ptr<Expr> logicalOr() {
+    auto expr = logicalAnd();
+    while (match({TokenType::OR})) {
+      auto op = previous();
+      auto right = logicalAnd();
+      expr = node<Logical>(op, expr, op, right);
+    }
+    return expr;
+  }
+
+  std::shared_ptr<Expr> logicalAnd() {
+    auto expr = equality();
+    while (match({TokenType::AND})) {
+      auto op = previous();
+      auto right = equality();
+      expr = node<Logical>(op, expr, op, right);
+    }
+    return expr;
+  }
 
   std::shared_ptr<Expr> equality() {
     auto expr = comparison();
     while (match({TokenType::BANG_EQUAL, TokenType::EQUAL_EQUAL})) {
       auto op = previous();
       auto right = comparison();
-      expr = std::make_shared<Binary>(expr, op, right);
+      expr = node<Binary>(op, expr, op, right);
     }
     return expr;
   }
@@ -40,7 +262,7 @@ class Parser {
                   TokenType::LESS_EQUAL})) {
       auto op = previous();
       auto right = term();
-      expr = std::make_shared<Binary>(expr, op, right);
+      expr = node<Binary>(op, expr, op, right);
     }
     return expr;
   }
@@ -50,7 +272,7 @@ class Parser {
     while (match({TokenType::MINUS, TokenType::PLUS})) {
       auto op = previous();
       auto right = factor();
-      expr = std::make_shared<Binary>(expr, op, right);
+      expr = node<Binary>(op, expr, op, right);
     }
     return expr;
   }
@@ -60,21 +282,72 @@ class Parser {
     while (match({TokenType::SLASH, TokenType::STAR})) {
       auto op = previous();
       auto right = unary();
-      expr = std::make_shared<Binary>(expr, op, right);
+      expr = node<Binary>(op, expr, op, right);
     }
     return expr;
   }
 
   std::shared_ptr<Expr> unary() {
-    if (match({TokenType::BANG, TokenType::MINUS})) {
-      auto op = previous();
-      auto right = unary();
-      return std::make_shared<Unary>(op, right);
+    // Prefix operators are collected in a loop instead of recursing, so long
+    // chains such as `!!!!x` do not use stack.
+    std::vector<Token> ops;
+    while (match({TokenType::BANG, TokenType::MINUS})) {
+      enterNesting();
+      ops.push_back(previous());
+    }
+    auto expr = call();
+    for (auto op = ops.rbegin(); op != ops.rend(); ++op) {
+      expr = node<Unary>(*op, *op, expr);
+      leaveNesting();
+    }
+    return expr;
+  }
+
+  std::shared_ptr<Expr> call() {
+    auto expr = primary();
+    while (true) {
+      if (match({TokenType::LEFT_PAREN})) {
+        expr = finishCall(expr);
+      } else if (match({TokenType::DOT})) {
+        auto name =
+            consume(TokenType::IDENTIFIER, "Expect property name after '.'.");
+        expr = node<Get>(name, expr, name);
+      } else {
+        break;
+      }
+    }
+    return expr;
+  }
+
+  std::shared_ptr<Expr> finishCall(std::shared_ptr<Expr> callee) {
+    enterNesting();
+    std::vector<std::shared_ptr<Expr>> arguments;
+    if (!check(TokenType::RIGHT_PAREN)) {
+      do {
+        if (arguments.size() >= maxArguments)
+          error(peek(), "Can't have more than 255 arguments.");
+        arguments.push_back(expression());
+      } while (match({TokenType::COMMA}));
     }
-    return primary();
+    auto paren = consume(TokenType::RIGHT_PAREN, "Expect ')' after arguments.");
+    leaveNesting();
+    return node<Call>(paren, callee, paren, arguments);
   }
 
   std::shared_ptr<Expr> primary() {
+    if (match({TokenType::LEFT_PAREN})) {
+      enterNesting();
+      auto expr = expression();
+      auto paren =
+          consume(TokenType::RIGHT_PAREN, "Expect ')' after expression.");
+      leaveNesting();
+      return node<Grouping>(paren, expr);
+    }
+    return atom();
+  }
+
+  // A primary expression with no subexpressions.
+  std::shared_ptr<Expr> atom() {
     if (match({TokenType::FALSE}))
       return std::make_shared<Literal>(false);
     if (match({TokenType::TRUE}))
@@ -82,19 +355,195 @@ class Parser {
     if (match({TokenType::NIL}))
       return std::make_shared<Literal>(nullptr);
     if (match({TokenType::NUMBER})) {
-      return std::make_shared<Literal>(std::stod(previous().getLexeme()));
+      return std::make_shared<Literal>(previous().getNumber());
     }
     if (match({TokenType::STRING})) {
-      return std::make_shared<Literal>(previous().getLexeme());
+      return std::make_shared<Literal>(previous().getString());
     }
-    if (match({TokenType::LEFT_PAREN})) {
-      auto expr = expression();
-      consume(TokenType::RIGHT_PAREN, "Expect ')' after expression.");
-      return std::make_shared<Grouping>(expr);
+    if (match({TokenType::SUPER})) {
+      auto keyword = previous();
+      consume(TokenType::DOT, "Expect '.' after 'super'.");
+      auto method =
+          consume(TokenType::IDENTIFIER, "Expect superclass method name.");
+      return std::make_shared<Super>(keyword, method);
     }
+    if (match({TokenType::THIS}))
+      return std::make_shared<This>(previous());
+    if (match({TokenType::IDENTIFIER}))
+      return std::make_shared<Variable>(previous());
     throw error(peek(), "Expect expression.");
   }
 
+  // Binding power of an infix operator, or 0 if the token is not one. These
+  // mirror the assignment() ... factor() levels above.
+  static int binaryPrecedence(TokenType type) {
+    switch (type) {
+    case TokenType::EQUAL:
+      return 1;
+    case TokenType::OR:
+      return 2;
+    case TokenType::AND:
+      return 3;
+    case TokenType::BANG_EQUAL:
+    case TokenType::EQUAL_EQUAL:
+      return 4;
+    case TokenType::GREATER:
+    case TokenType::GREATER_EQUAL:
+    case TokenType::LESS:
+    case TokenType::LESS_EQUAL:
+      return 5;
+    case TokenType::MINUS:
+    case TokenType::PLUS:
+      return 6;
+    case TokenType::SLASH:
+    case TokenType::STAR:
+      return 7;
+    default:
+      return 0;
+    }
+  }
+
+  // Explicit-stack (shunting-yard) parser for the same grammar as
+  // expression(). Pending operators and operands live in vectors, so nesting
+  // depth is bounded only by the height limit and not by the C++ stack.
+  std::shared_ptr<Expr> iterativeExpression() {
+    // Precedence of an open call, of an open parenthesis and of prefix
+    // operators; infix operators never reduce past the first two and always
+    // reduce the last. Assignment is the one right-associative operator.
+    constexpr int call = -1;
+    constexpr int group = 0;
+    constexpr int assign = 1;
+    constexpr int prefix = 8;
+
+    struct Pending {
+      Token op;
+      int precedence;
+      // For an open call, the index of its callee in `operands`; the
+      // arguments parsed so far follow it.
+      size_t callee = 0;
+    };
+    std::vector<Pending> operators;
+    std::vector<std::shared_ptr<Expr>> operands;
+
+    auto reduce = [&] {
+      auto pending = std::move(operators.back());
+      operators.pop_back();
+      auto right = std::move(operands.back());
+      operands.pop_back();
+      if (pending.precedence == prefix) {
+        leaveNesting();
+        operands.push_back(node<Unary>(pending.op, pending.op, right));
+        return;
+      }
+      auto left = std::move(operands.back());
+      operands.pop_back();
+      if (pending.precedence == assign) {
+        leaveNesting();
+        operands.push_back(assignmentTo(left, pending.op, right));
+      } else if (pending.op.getType() == TokenType::AND ||
+                 pending.op.getType() == TokenType::OR) {
+        operands.push_back(node<Logical>(pending.op, left, pending.op, right));
+      } else {
+        operands.push_back(node<Binary>(pending.op, left, pending.op, right));
+      }
+    };
+
+    auto closeCall = [&](const Token &paren) {
+      auto callee = operators.back().callee;
+      operators.pop_back();
+      std::vector<std::shared_ptr<Expr>> arguments(
+          std::make_move_iterator(operands.begin() + callee + 1),
+          std::make_move_iterator(operands.end()));
+      operands.resize(callee + 1);
+      operands.back() = node<Call>(paren, operands.back(), paren, arguments);
+      leaveNesting();
+    };
+
+    while (true) {
+      // Operand position: any number of prefix operators and parentheses.
+      while (true) {
+        if (match({TokenType::BANG, TokenType::MINUS})) {
+          enterNesting();
+          operators.push_back({previous(), prefix});
+        } else if (match({TokenType::LEFT_PAREN})) {
+          enterNesting();
+          operators.push_back({previous(), group});
+        } else {
+          break;
+        }
+      }
+      operands.push_back(atom());
+
+      // Operator position: apply calls and property accesses, and close
+      // groups and calls, until an infix operator or an argument continues
+      // the expression or nothing is left open.
+      while (true) {
+        if (match({TokenType::LEFT_PAREN})) {
+          enterNesting();
+          operators.push_back({previous(), call, operands.size() - 1});
+          if (match({TokenType::RIGHT_PAREN})) {
+            closeCall(previous());
+            continue;
+          }
+          break;
+        }
+        if (match({TokenType::DOT})) {
+          auto name = consume(TokenType::IDENTIFIER,
+                              "Expect property name after '.'.");
+          operands.back() = node<Get>(name, operands.back(), name);
+          continue;
+        }
+        int precedence = binaryPrecedence(peek().getType());
+        if (precedence > 0) {
+          auto op = advance();
+          while (!operators.empty() &&
+                 (operators.back().precedence > precedence ||
+                  (operators.back().precedence == precedence &&
+                   precedence != assign)))
+            reduce();
+          if (precedence == assign)
+            enterNesting();
+          operators.push_back({op, precedence});
+          break;
+        }
+        while (!operators.empty() && operators.back().precedence > group)
+          reduce();
+        if (operators.empty())
+          return operands.back();
+        if (operators.back().precedence == call) {
+          if (match({TokenType::COMMA})) {
+            if (operands.size() - operators.back().callee - 1 >= maxArguments)
+              error(peek(), "Can't have more than 255 arguments.");
+            break;
+          }
+          closeCall(
+              consume(TokenType::RIGHT_PAREN, "Expect ')' after arguments."));
+          continue;
+        }
+        auto paren =
+            consume(TokenType::RIGHT_PAREN, "Expect ')' after expression.");
+        operators.pop_back();
+        leaveNesting();
+        operands.back() = node<Grouping>(paren, operands.back());
+      }
+    }
+  }
+
+  // Makes an expression node, rejecting it at `token` if evaluating it would
+  // nest deeper than maxDepth. Left-associative chains such as 1 + 1 + ...
+  // are built without recursion, so this is the only bound on their height.
+  template <typename T, typename... Args>
+  std::shared_ptr<Expr> node(const Token &token, Args &&...args) {
+    auto expr = std::make_shared<T>(std::forward<Args>(args)...);
+    if (expr->height > maxDepth)
+      throw error(token, "Expression nesting too deep.");
+    return expr;
+  }
+
+  void enterNesting() { ++depth; }
+
+  void leaveNesting() { --depth; }
+
   bool match(const std::vector<TokenType> &types) {
     for (const auto &type : types) {
       if (check(type)) {
@@ -123,14 +572,22 @@ class Parser {
 
   Token previous() { return tokens[current - 1]; }
 
-  Token consume(TokenType type, const char *message) {
+  Token consume(TokenType type, const std::string &message) {
     if (check(type))
       return advance();
     throw error(peek(), message);
   }
 
-  static ParserError error(const Token &token, const char *message) {
-    Lox::Lox::report(token.getLine(), "", message);
+  // Reports a syntax error, which stops the program from running. Returns
+  // the exception to throw when the parse cannot continue.
+  static ParserError error(const Token &token, const std::string &message) {
+    Lox::Lox::hadError = true;
+    if (token.getType() == TokenType::EoF) {
+      Lox::Lox::report(token.getLine(), " at end", message.c_str());
+    } else {
+      auto where = " at '" + token.getLexeme() + "'";
+      Lox::Lox::report(token.getLine(), where.c_str(), message.c_str());
+    }
     return {};
   }
 
@@ -157,15 +614,30 @@ class Parser {
   }
 
 public:
-  explicit Parser(std::vector<Token> tokens) : tokens(std::move(tokens)) {}
+  // maxDepth bounds the height of expressions, which is how deeply the
+  // Interpreter nests evaluating them; taller ones are reported as a parse
+  // error rather than failing when run.
+  explicit Parser(std::vector<Token> tokens, int maxDepth = 10000)
+      : tokens(std::move(tokens)), maxDepth(maxDepth) {}
 
-  std::shared_ptr<Expr> parse() {
-    try {
-      return expression();
-    } catch (const ParserError &) {
-      synchronize();
-      return nullptr;
+  // Parses a whole program. Declarations that fail to parse are reported
+  // and left out, and parsing resumes at the next statement.
+  std::vector<std::shared_ptr<Statement>> parse() {
+    std::vector<std::shared_ptr<Statement>> statements;
+    while (!isAtEnd()) {
+      if (auto statement = declaration())
+        statements.push_back(statement);
     }
+    return statements;
+  }
+
+  // As parse(), for a line typed at the prompt: a final expression statement
+  // may leave out its ';', and prints its value.
+  std::vector<std::shared_ptr<Statement>> parseRepl() {
+    repl = true;
+    auto statements = parse();
+    repl = false;
+    return statements;
   }
 };
 } // namespace Lox
@@ -0,0 +1,331 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+#ifndef LOX_RESOLVER_H
+#define LOX_RESOLVER_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Expr.h"
+#include "Lox.h"
+#include "Statement.h"
+
+namespace Lox {
+
+// Static pass run before execution. Every local variable is assigned a slot
+// in the frame of the scope that declares it, and every Variable, Assign,
+// This and Super is annotated with how many frames out and at which slot
+// its variable lives. At runtime a local access is then a pointer walk and
+// an array index; only globals are looked up by name.
+//
+// It also finds the frames a closure may capture. A function or class
+// declaration closes over every frame enclosing it, so those Blocks and
+// Functions are marked `captured`; the frames of all others are dead once
+// their block or call exits, and need not be allocated on the heap.
+class Resolver : Expr::Visitor, Statement::Visitor {
+  enum class FunctionType { None, Function, Initializer, Method };
+  enum class ClassType { None, Class, Subclass };
+
+  struct Local {
+    int slot;
+    bool defined;
+  };
+
+  struct Scope {
+    std::unordered_map<std::string, Local> locals;
+    int size = 0;
+    // The `captured` flag of the Block or Function the frame belongs to, or
+    // null for the frames that bind `this` and `super`.
+    bool *captured = nullptr;
+  };
+
+  std::vector<Scope> scopes;
+  // How many times each global is declared or assigned, and the function
+  // declarations among the declarations.
+  std::unordered_map<std::string, int> globalStores;
+  std::unordered_map<std::string, const Function *> globalFunctions;
+  FunctionType currentFunction = FunctionType::None;
+  ClassType currentClass = ClassType::None;
+
+  void beginScope(bool *captured = nullptr) {
+    scopes.emplace_back();
+    scopes.back().captured = captured;
+  }
+
+  int endScope() {
+    int size = scopes.back().size;
+    scopes.pop_back();
+    return size;
+  }
+
+  // Reserves a slot for `name` in the innermost scope, or returns -1 when
+  // declaring a global.
+  int declare(const Token &name) {
+    if (scopes.empty()) {
+      ++globalStores[name.getLexeme()];
+      return -1;
+    }
+    auto &scope = scopes.back();
+    if (scope.locals.count(name.getLexeme()))
+      Lox::error(name.getLine(),
+                 "Already a variable with this name in this scope.");
+    int slot = scope.size++;
+    scope.locals[name.getLexeme()] = {slot, false};
+    return slot;
+  }
+
+  void define(const Token &name) {
+    if (scopes.empty())
+      return;
+    scopes.back().locals[name.getLexeme()].defined = true;
+  }
+
+  // Declares a name that is bound implicitly, such as `this` and `super`.
+  void defineImplicit(const std::string &name) {
+    auto &scope = scopes.back();
+    scope.locals[name] = {scope.size++, true};
+  }
+
+  // Records that a closure is created in the innermost scope, where it
+  // holds on to every enclosing frame.
+  void capture() {
+    for (auto &scope : scopes)
+      if (scope.captured != nullptr)
+        *scope.captured = true;
+  }
+
+  void resolveLocal(Slot &resolved, const std::string &name) {
+    for (int i = static_cast<int>(scopes.size()) - 1; i >= 0; --i) {
+      auto found = scopes[i].locals.find(name);
+      if (found != scopes[i].locals.end()) {
+        resolved.depth = static_cast<int>(scopes.size()) - 1 - i;
+        resolved.slot = found->second.slot;
+        return;
+      }
+    }
+    resolved = {};
+  }
+
+  void resolveFunction(const Function &function, FunctionType type) {
+    auto enclosingFunction = currentFunction;
+    currentFunction = type;
+
+    beginScope(&function.captured);
+    for (const auto &param : function.params) {
+      declare(param);
+      define(param);
+    }
+    resolve(function.body);
+    function.frameSize = endScope();
+
+    currentFunction = enclosingFunction;
+  }
+
+  // Expressions recurse without a guard: the Parser bounds their height.
+  void resolve(const Expr *expr) { expr->accept(*this); }
+
+  void resolve(Statement *stmt) { stmt->accept(*this); }
+
+public:
+  // Errors are reported through Lox::error and set Lox::hadError.
+  void resolve(const std::vector<std::shared_ptr<Statement>> &statements) {
+    for (const auto &stmt : statements)
+      resolve(stmt.get());
+  }
+
+  // The global functions in what was resolved so far that nothing else is
+  // ever stored to, by name: wherever such a global is defined, it holds
+  // that function.
+  std::unordered_map<std::string, const Function *> constantFunctions() const {
+    std::unordered_map<std::string, const Function *> functions;
+    for (const auto &[name, function] : globalFunctions)
+      if (globalStores.at(name) == 1)
+        functions[name] = function;
+    return functions;
+  }
+
+  std::any visitBlock(const Block &stmt) override {
+    beginScope(&stmt.captured);
+    resolve(stmt.statements);
+    stmt.frameSize = endScope();
+    return {};
+  }
+
+  std::any visitClass(const Class &stmt) override {
+    auto enclosingClass = currentClass;
+    currentClass = ClassType::Class;
+
+    stmt.slot = declare(stmt.name);
+    define(stmt.name);
+    capture();
+
+    if (stmt.superclass) {
+      if (stmt.name.getLexeme() == stmt.superclass->name.getLexeme())
+        Lox::error(stmt.superclass->name.getLine(),
+                   "A class can't inherit from itself.");
+      currentClass = ClassType::Subclass;
+      resolve(stmt.superclass.get());
+
+      beginScope();
+      defineImplicit("super");
+    }
+
+    beginScope();
+    defineImplicit("this");
+    for (const auto &method : stmt.methods) {
+      auto type = method->name.getLexeme() == "init"
+                      ? FunctionType::Initializer
+                      : FunctionType::Method;
+      resolveFunction(*method, type);
+    }
+    endScope();
+
+    if (stmt.superclass)
+      endScope();
+
+    currentClass = enclosingClass;
+    return {};
+  }
+
+  std::any visitExpression(const Expression &stmt) override {
+    resolve(stmt.expression.get());
+    return {};
+  }
+
+  std::any visitFunction(const Function &stmt) override {
+    stmt.slot = declare(stmt.name);
+    define(stmt.name);
+    if (stmt.slot < 0)
+      globalFunctions[stmt.name.getLexeme()] = &stmt;
+    capture();
+    resolveFunction(stmt, FunctionType::Function);
+    return {};
+  }
+
+  std::any visitIf(const If &stmt) override {
+    resolve(stmt.condition.get());
+    resolve(stmt.thenBranch.get());
+    if (stmt.elseBranch)
+      resolve(stmt.elseBranch.get());
+    return {};
+  }
+
+  std::any visitPrint(const Print &stmt) override {
+    resolve(stmt.expression.get());
+    return {};
+  }
+
+  std::any visitReturn(const Return &stmt) override {
+    if (currentFunction == FunctionType::None)
+      Lox::error(stmt.keyword.getLine(), "Can't return from top-level code.");
+    if (stmt.value) {
+      if (currentFunction == FunctionType::Initializer)
+        Lox::error(stmt.keyword.getLine(),
+                   "Can't return a value from an initializer.");
+      stmt.tailCall = dynamic_cast<const Call *>(stmt.value.get()) != nullptr;
+      resolve(stmt.value.get());
+    }
+    return {};
+  }
+
+  std::any visitVar(const Var &stmt) override {
+    stmt.slot = declare(stmt.name);
+    if (stmt.initializer)
+      resolve(stmt.initializer.get());
+    define(stmt.name);
+    return {};
+  }
+
+  std::any visitWhile(const While &stmt) override {
+    resolve(stmt.condition.get());
+    resolve(stmt.body.get());
+    return {};
+  }
+
+  std::any visitAssign(const Assign &expr) override {
+    resolve(expr.value.get());
+    resolveLocal(expr.resolved, expr.name.getLexeme());
+    if (expr.resolved.depth < 0)
+      ++globalStores[expr.name.getLexeme()];
+    return {};
+  }
+
+  std::any visitBinary(const Binary &expr) override {
+    resolve(expr.left.get());
+    resolve(expr.right.get());
+    return {};
+  }
+
+  std::any visitCall(const Call &expr) override {
+    resolve(expr.callee.get());
+    for (const auto &argument : expr.arguments)
+      resolve(argument.get());
+    return {};
+  }
+
+  std::any visitGet(const Get &expr) override {
+    resolve(expr.object.get());
+    return {};
+  }
+
+  std::any visitGrouping(const Grouping &expr) override {
+    resolve(expr.expression.get());
+    return {};
+  }
+
+  std::any visitLiteral(const Literal &expr) override { return {}; }
+
+  std::any visitLogical(const Logical &expr) override {
+    resolve(expr.left.get());
+    resolve(expr.right.get());
+    return {};
+  }
+
+  std::any visitSet(const Set &expr) override {
+    resolve(expr.value.get());
+    resolve(expr.object.get());
+    return {};
+  }
+
+  std::any visitSuper(const Super &expr) override {
+    if (currentClass == ClassType::None)
+      Lox::error(expr.keyword.getLine(),
+                 "Can't use 'super' outside of a class.");
+    else if (currentClass != ClassType::Subclass)
+      Lox::error(expr.keyword.getLine(),
+                 "Can't use 'super' in a class with no superclass.");
+    resolveLocal(expr.resolved, "super");
+    return {};
+  }
+
+  std::any visitThis(const This &expr) override {
+    if (currentClass == ClassType::None)
+      Lox::error(expr.keyword.getLine(),
+                 "Can't use 'this' outside of a class.");
+    resolveLocal(expr.resolved, "this");
+    return {};
+  }
+
+  std::any visitUnary(const Unary &expr) override {
+    resolve(expr.right.get());
+    return {};
+  }
+
+  std::any visitVariable(const Variable &expr) override {
+    if (!scopes.empty()) {
+      auto found = scopes.back().locals.find(expr.name.getLexeme());
+      if (found != scopes.back().locals.end() && !found->second.defined)
+        Lox::error(expr.name.getLine(),
+                   "Can't read local variable in its own initializer.");
+    }
+    resolveLocal(expr.resolved, expr.name.getLexeme());
+    return {};
+  }
+};
+} // namespace Lox
+
+#endif // LOX_RESOLVER_H
@@ -208,7 +208,7 @@ class Scanner {
       break;
     case '\n':
       line++;
-    //                break;
+      break;
     case '"':
       string();
       break;
@@ -0,0 +1,66 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+#ifndef LOX_SHAPE_H
+#define LOX_SHAPE_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace Lox {
+
+// A hidden class describing the field layout of an instance.
+//
+// Shapes form a transition tree rooted at the empty shape: adding field `x`
+// to an instance of shape S moves it to S's child for `x`, creating that
+// child the first time. Instances that gain the same fields in the same
+// order therefore share one Shape, and each field lives at a fixed slot.
+//
+// The tree is shared by every Heap and lives for the whole process, so a
+// Shape pointer cached in the AST can never dangle or be reused for a
+// different layout.
+class Shape {
+  Shape *parent = nullptr;
+  std::string name;
+  int slot = -1;
+  std::unordered_map<std::string, std::unique_ptr<Shape>> transitions;
+
+  Shape(Shape *parent, std::string name, int slot)
+      : parent(parent), name(std::move(name)), slot(slot) {}
+
+public:
+  Shape() = default;
+  Shape(const Shape &) = delete;
+  Shape &operator=(const Shape &) = delete;
+
+  // The shape of an instance with no fields.
+  static Shape *root() {
+    static Shape empty;
+    return &empty;
+  }
+
+  // Number of fields an instance of this shape has.
+  [[nodiscard]] int fieldCount() const { return slot + 1; }
+
+  // Slot of field `field`, or -1 if this shape does not have it.
+  [[nodiscard]] int slotOf(const std::string &field) const {
+    for (auto shape = this; shape->parent != nullptr; shape = shape->parent) {
+      if (shape->name == field)
+        return shape->slot;
+    }
+    return -1;
+  }
+
+  // The shape reached by adding `field` after the fields of this one.
+  Shape *withField(const std::string &field) {
+    auto &next = transitions[field];
+    if (!next)
+      next.reset(new Shape(this, field, slot + 1));
+    return next.get();
+  }
+};
+} // namespace Lox
+
+#endif // LOX_SHAPE_H
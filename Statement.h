@@ -44,6 +44,11 @@ struct Statement {
 
 struct Block : public Statement {
   std::vector<std::shared_ptr<Statement>> statements;
+  // Number of local slots the block's frame needs.
+  mutable int frameSize = 0;
+  // Whether a closure may capture the block's frame, so it can outlive the
+  // block.
+  mutable bool captured = false;
 
   explicit Block(std::vector<std::shared_ptr<Statement>> statements)
       : statements(std::move(statements)) {}
@@ -57,6 +62,8 @@ struct Class : public Statement {
   Token name;
   std::shared_ptr<Variable> superclass;
   std::vector<std::shared_ptr<Function>> methods;
+  // Slot the class is bound to, or -1 for a global.
+  mutable int slot = -1;
 
   Class(Token name, std::shared_ptr<Variable> superclass,
         std::vector<std::shared_ptr<Function>> methods)
@@ -83,6 +90,12 @@ struct Function : public Statement {
   Token name;
   std::vector<Token> params;
   std::vector<std::shared_ptr<Statement>> body;
+  // Slot the function is bound to, or -1 for a global.
+  mutable int slot = -1;
+  // Number of local slots a call frame needs, parameters first.
+  mutable int frameSize = 0;
+  // Whether a closure may capture a call frame, so it can outlive the call.
+  mutable bool captured = false;
 
   Function(Token name, std::vector<Token> params,
            std::vector<std::shared_ptr<Statement>> body)
@@ -123,6 +136,9 @@ struct Print : public Statement {
 struct Return : public Statement {
   Token keyword;
   std::shared_ptr<Expr> value;
+  // Set by the Resolver when `value` is a call in tail position, which
+  // then replaces the current call instead of nesting inside it.
+  mutable bool tailCall = false;
 
   Return(Token keyword, std::shared_ptr<Expr> value)
       : keyword(std::move(keyword)), value(std::move(value)) {}
@@ -135,6 +151,8 @@ struct Return : public Statement {
 struct Var : public Statement {
   Token name;
   std::shared_ptr<Expr> initializer;
+  // Slot the variable is bound to, or -1 for a global.
+  mutable int slot = -1;
 
   Var(Token name, std::shared_ptr<Expr> initializer)
       : name(std::move(name)), initializer(std::move(initializer)) {}
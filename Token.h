@@ -29,7 +29,7 @@ public:
 
   [[nodiscard]] TokenType getType() const { return type; }
 
-  [[nodiscard]] std::string getLexeme() const { return lexeme; }
+  [[nodiscard]] const std::string &getLexeme() const { return lexeme; }
 
   [[nodiscard]] int getLine() const { return line; }
 
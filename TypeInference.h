@@ -0,0 +1,386 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+#ifndef LOX_TYPEINFERENCE_H
+#define LOX_TYPEINFERENCE_H
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <set>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "Expr.h"
+#include "Statement.h"
+
+namespace Lox {
+
+// Proves which values in one function are always numbers, so a compiler can
+// hold them as raw doubles. Runs after the Resolver, over the body of a
+// Function or over the top-level statements of a program.
+//
+// The analysis is flow sensitive. A local is a number from the point a
+// number is stored in it until something else may be, and also once an
+// operation that fails on anything but numbers - `n - 1`, `n < 2` - has
+// completed with it as an operand, since a runtime error ends the program.
+// Facts are intersected where control flow meets and iterated to a fixed
+// point around loops. Only the function's own locals are tracked: globals,
+// variables of enclosing functions and locals a nested function captures
+// may change during any call.
+class TypeInference : Expr::Visitor, Statement::Visitor {
+public:
+  // A local variable: the Block or Function whose frame holds it, and its
+  // slot there.
+  using Local = std::pair<const void *, int>;
+
+private:
+  struct State {
+    bool reachable = true;
+    std::set<Local> numbers;
+
+    bool operator==(const State &) const = default;
+  };
+
+  State state;
+  // Frames of the enclosing scopes, innermost last. Null stands for the
+  // frames that bind `this` and `super`.
+  std::vector<const void *> scopes;
+  // How many functions deep the visit is inside the one analysed, and how
+  // many scopes that one had when the outermost of them was entered.
+  int nested = 0;
+  std::size_t own = 0;
+  // Whether the expression just visited is a number.
+  bool number = false;
+  // Incremented whenever a local is stored to.
+  int stores = 0;
+
+  std::unordered_set<const Expr *> numberExprs;
+  std::set<Local> declared;
+  // Locals that may hold something other than a number.
+  std::set<Local> mixed;
+  std::set<Local> captured;
+
+  static State join(const State &a, const State &b) {
+    if (!a.reachable)
+      return b;
+    if (!b.reachable)
+      return a;
+    State joined;
+    for (const auto &local : a.numbers)
+      if (b.numbers.count(local))
+        joined.numbers.insert(local);
+    return joined;
+  }
+
+  // The tracked local `resolved` refers to, if any. Within nested
+  // functions this only records which locals they capture.
+  std::optional<Local> local(const Slot &resolved) {
+    if (resolved.depth < 0)
+      return std::nullopt;
+    auto index = static_cast<int>(scopes.size()) - 1 - resolved.depth;
+    if (index < 0 || scopes[index] == nullptr)
+      return std::nullopt;
+    Local local{scopes[index], resolved.slot};
+    if (nested > 0) {
+      if (static_cast<std::size_t>(index) < own)
+        captured.insert(local);
+      return std::nullopt;
+    }
+    if (captured.count(local))
+      return std::nullopt;
+    return local;
+  }
+
+  void store(std::optional<Local> local, bool isNumber) {
+    if (!local)
+      return;
+    ++stores;
+    if (!isNumber)
+      mixed.insert(*local);
+    if (isNumber && state.reachable)
+      state.numbers.insert(*local);
+    else
+      state.numbers.erase(*local);
+  }
+
+  void define(int slot, bool isNumber) {
+    if (slot < 0 || nested > 0)
+      return;
+    Local defined{scopes.back(), slot};
+    declared.insert(defined);
+    if (!captured.count(defined))
+      store(defined, isNumber);
+  }
+
+  // Records that `operand`, if it reads a local, found a number there.
+  void refine(const Expr *operand) {
+    while (auto grouping = dynamic_cast<const Grouping *>(operand))
+      operand = grouping->expression.get();
+    auto variable = dynamic_cast<const Variable *>(operand);
+    if (variable == nullptr || !state.reachable)
+      return;
+    if (auto read = local(variable->resolved))
+      state.numbers.insert(*read);
+  }
+
+  bool visit(const Expr *expr) {
+    expr->accept(*this);
+    if (nested == 0) {
+      if (number)
+        numberExprs.insert(expr);
+      else
+        numberExprs.erase(expr);
+    }
+    return number;
+  }
+
+  void visit(Statement *stmt) { stmt->accept(*this); }
+
+  void visit(const std::vector<std::shared_ptr<Statement>> &statements) {
+    for (const auto &statement : statements)
+      visit(statement.get());
+  }
+
+  // Visits a function nested in the one analysed, for its captures.
+  void visitNested(const Function &function, int bindings) {
+    if (nested++ == 0)
+      own = scopes.size();
+    for (int i = 0; i < bindings; ++i)
+      scopes.push_back(nullptr);
+    scopes.push_back(&function);
+    visit(function.body);
+    scopes.resize(scopes.size() - bindings - 1);
+    --nested;
+  }
+
+  // Runs the analysis twice: the first finds the captured locals, which
+  // the second then leaves untracked.
+  template <typename Body> void run(Body body) {
+    for (int pass = 0; pass < 2; ++pass) {
+      state = {};
+      scopes.clear();
+      numberExprs.clear();
+      declared.clear();
+      mixed.clear();
+      body();
+    }
+  }
+
+public:
+  void analyse(const Function &function) {
+    run([&] {
+      scopes.push_back(&function);
+      for (std::size_t i = 0; i < function.params.size(); ++i)
+        define(static_cast<int>(i), false);
+      visit(function.body);
+    });
+  }
+
+  void analyse(const std::vector<std::shared_ptr<Statement>> &statements) {
+    run([&] { visit(statements); });
+  }
+
+  // Whether `expr` evaluates to a number wherever it completes.
+  bool isNumber(const Expr *expr) const { return numberExprs.count(expr); }
+
+  // Whether `local` only ever holds numbers and no closure can see it, so
+  // it may live in a raw double.
+  bool isUnboxed(const Local &local) const {
+    return declared.count(local) && !mixed.count(local) &&
+           !captured.count(local);
+  }
+
+  // The slots of `frame` that isUnboxed.
+  std::vector<int> unboxedSlots(const void *frame) const {
+    std::vector<int> slots;
+    for (const auto &local : declared)
+      if (local.first == frame && isUnboxed(local))
+        slots.push_back(local.second);
+    return slots;
+  }
+
+  std::any visitLiteral(const Literal &expr) override {
+    number = std::holds_alternative<double>(expr.value);
+    return {};
+  }
+
+  std::any visitGrouping(const Grouping &expr) override {
+    visit(expr.expression.get());
+    return {};
+  }
+
+  std::any visitUnary(const Unary &expr) override {
+    visit(expr.right.get());
+    number = expr.op.getType() == TokenType::MINUS;
+    if (number)
+      refine(expr.right.get());
+    return {};
+  }
+
+  std::any visitBinary(const Binary &expr) override {
+    auto left = visit(expr.left.get());
+    auto before = stores;
+    auto right = visit(expr.right.get());
+    // The left operand was read before the right one ran, so says nothing
+    // of the local once the right one has stored to it.
+    auto refineBoth = [&] {
+      if (stores == before)
+        refine(expr.left.get());
+      refine(expr.right.get());
+    };
+    switch (expr.op.getType()) {
+    case TokenType::MINUS:
+    case TokenType::STAR:
+    case TokenType::SLASH:
+      refineBoth();
+      number = true;
+      break;
+    case TokenType::PLUS:
+      number = left && right;
+      break;
+    case TokenType::GREATER:
+    case TokenType::GREATER_EQUAL:
+    case TokenType::LESS:
+    case TokenType::LESS_EQUAL:
+      refineBoth();
+      number = false;
+      break;
+    default:
+      number = false;
+    }
+    return {};
+  }
+
+  std::any visitAssign(const Assign &expr) override {
+    auto value = visit(expr.value.get());
+    store(local(expr.resolved), value);
+    number = value;
+    return {};
+  }
+
+  std::any visitCall(const Call &expr) override {
+    visit(expr.callee.get());
+    for (const auto &argument : expr.arguments)
+      visit(argument.get());
+    number = false;
+    return {};
+  }
+
+  std::any visitGet(const Get &expr) override {
+    visit(expr.object.get());
+    number = false;
+    return {};
+  }
+
+  std::any visitLogical(const Logical &expr) override {
+    visit(expr.left.get());
+    visit(expr.right.get());
+    number = false;
+    return {};
+  }
+
+  std::any visitSet(const Set &expr) override {
+    visit(expr.object.get());
+    visit(expr.value.get());
+    number = false;
+    return {};
+  }
+
+  std::any visitSuper(const Super &expr) override {
+    number = false;
+    return {};
+  }
+
+  std::any visitThis(const This &expr) override {
+    number = false;
+    return {};
+  }
+
+  std::any visitVariable(const Variable &expr) override {
+    auto read = local(expr.resolved);
+    number = read && state.reachable && state.numbers.count(*read);
+    return {};
+  }
+
+  std::any visitBlock(const Block &stmt) override {
+    scopes.push_back(&stmt);
+    visit(stmt.statements);
+    scopes.pop_back();
+    return {};
+  }
+
+  std::any visitClass(const Class &stmt) override {
+    if (stmt.superclass)
+      visit(stmt.superclass.get());
+    define(stmt.slot, false);
+    for (const auto &method : stmt.methods)
+      visitNested(*method, stmt.superclass ? 2 : 1);
+    return {};
+  }
+
+  std::any visitExpression(const Expression &stmt) override {
+    visit(stmt.expression.get());
+    return {};
+  }
+
+  std::any visitFunction(const Function &stmt) override {
+    define(stmt.slot, false);
+    visitNested(stmt, 0);
+    return {};
+  }
+
+  std::any visitIf(const If &stmt) override {
+    visit(stmt.condition.get());
+    auto otherwise = state;
+    visit(stmt.thenBranch.get());
+    std::swap(state, otherwise);
+    if (stmt.elseBranch)
+      visit(stmt.elseBranch.get());
+    state = join(state, otherwise);
+    return {};
+  }
+
+  std::any visitPrint(const Print &stmt) override {
+    visit(stmt.expression.get());
+    return {};
+  }
+
+  std::any visitReturn(const Return &stmt) override {
+    if (stmt.value)
+      visit(stmt.value.get());
+    if (nested == 0)
+      state = {false, {}};
+    return {};
+  }
+
+  std::any visitVar(const Var &stmt) override {
+    bool isNumber = stmt.initializer && visit(stmt.initializer.get());
+    define(stmt.slot, isNumber);
+    return {};
+  }
+
+  std::any visitWhile(const While &stmt) override {
+    // Facts recorded on the last pass, which starts from the fixed point,
+    // hold on every iteration.
+    auto entry = state;
+    while (true) {
+      state = entry;
+      visit(stmt.condition.get());
+      auto exit = state;
+      visit(stmt.body.get());
+      auto next = join(entry, state);
+      if (next == entry || nested > 0) {
+        state = exit;
+        break;
+      }
+      entry = std::move(next);
+    }
+    return {};
+  }
+};
+} // namespace Lox
+
+#endif // LOX_TYPEINFERENCE_H
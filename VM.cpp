@@ -0,0 +1,501 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "BinaryDispatch.h"
+#include "Statement.h"
+#include "VM.h"
+
+// GCC and Clang support taking the address of a label, which lets every
+// instruction jump straight to the next handler instead of going back
+// through a single switch.
+#if defined(__GNUC__) || defined(__clang__)
+#define LOX_COMPUTED_GOTO 1
+#else
+#define LOX_COMPUTED_GOTO 0
+#endif
+
+namespace Lox {
+ObjClass *VM::makeClass(const ClassCode &code, ObjClass *superclass,
+                        const std::shared_ptr<Environment> &environment) {
+  const auto &declaration = *code.declaration;
+  auto klass =
+      heap.allocate<ObjClass>(declaration.name.getLexeme(), superclass);
+
+  // Methods of a subclass close over a frame that binds `super`.
+  auto closure = environment;
+  if (superclass != nullptr) {
+    closure = std::make_shared<Environment>(std::move(closure), 1);
+    closure->slots[0] = Value::object(superclass);
+  }
+  for (std::size_t i = 0; i < code.methods.size(); ++i) {
+    const auto &name = declaration.methods[i]->name.getLexeme();
+    auto method = heap.allocate<ObjFunction>(code.methods[i]->declaration,
+                                             closure, name == "init");
+    method->chunk = code.methods[i];
+    klass->addMethod(name, method);
+  }
+  return klass;
+}
+
+Value VM::run(const Chunk &chunk) {
+  // The script runs in a frame of its own over a dummy callee slot.
+  frames.clear();
+  stack.resize(std::max(stack.size(), std::size_t(chunk.maxStack) + 1));
+  frames.push_back({&chunk, chunk.code.data(), 1, nullptr, nullptr, 0});
+
+  CallFrame *frame;
+  const uint8_t *ip;
+  const Value *constants;
+  Value *slots;
+  Value *sp = stack.data() + 1;
+
+#define READ_SHORT() (ip += 2, static_cast<uint16_t>(ip[-2] << 8 | ip[-1]))
+#define PUSH(value) (*sp++ = (value))
+#define POP() (*--sp)
+#define LOAD_FRAME()                                                           \
+  (frame = &frames.back(), ip = frame->ip,                                     \
+   constants = frame->chunk->constants.data(),                                 \
+   slots = stack.data() + frame->slots)
+
+  LOAD_FRAME();
+
+  // Calls and backward jumps are the collector's safe points: every live
+  // value is then on the stack, in a global or in a frame.
+  auto collectGarbage = [&] {
+    heap.collect([&](Heap &heap) {
+      for (auto slot = stack.data(); slot < sp; ++slot)
+        heap.mark(*slot);
+      for (const auto &callFrame : frames) {
+        heap.mark(callFrame.function);
+        heap.mark(callFrame.environment.get());
+      }
+      for (auto value : globals.values)
+        heap.mark(value);
+    });
+  };
+
+  // Starts running `function` on the `count` arguments from stack index
+  // `arguments`, which follow the callee.
+  auto enter = [&](ObjFunction *function, std::size_t arguments, int count,
+                   int base) {
+    const auto &body = *function->chunk;
+    const auto &declaration = *function->declaration;
+    auto needed = arguments + static_cast<std::size_t>(body.maxStack);
+    if (needed > stack.size()) {
+      auto top = sp - stack.data();
+      stack.resize(std::max(needed, stack.size() * 2));
+      sp = stack.data() + top;
+    }
+    Value *first = stack.data() + arguments;
+    auto environment = function->closure;
+    if (declaration.captured) {
+      environment =
+          std::make_shared<Environment>(std::move(environment),
+                                        declaration.frameSize);
+      std::copy_n(first, count, environment->slots.begin());
+      sp = first;
+    } else {
+      std::fill(first + count, first + declaration.frameSize, Value::nil());
+      sp = first + declaration.frameSize;
+    }
+    frames.push_back({&body, body.code.data(), arguments, function,
+                      std::move(environment), base});
+    if (heap.shouldCollect())
+      collectGarbage();
+  };
+
+  // Calls the callee below the top `count` values, which CheckCall has
+  // already found callable with that many arguments. A class with no
+  // initializer leaves the new instance as the result; anything else starts
+  // a new frame.
+  auto call = [&](int count, int base) {
+    Value *callee = sp - count - 1;
+    ObjFunction *function;
+    if (callee->isClass()) {
+      auto klass = callee->asClass();
+      *callee = heap.instance(klass);
+      if (klass->initializer == nullptr)
+        return;
+      function = bind(klass->initializer, *callee);
+    } else {
+      function = callee->asFunction();
+    }
+    frame->ip = ip;
+    enter(function, static_cast<std::size_t>(sp - count - stack.data()),
+          count, base);
+    LOAD_FRAME();
+  };
+
+// Numbers take the inline path; everything else, including type errors,
+// goes through the shared binary dispatch table.
+#define BINARY(token, make, op)                                                \
+  do {                                                                         \
+    Value b = POP();                                                           \
+    Value a = POP();                                                           \
+    if (a.isNumber() && b.isNumber())                                          \
+      PUSH(make(a.asNumber() op b.asNumber()));                                \
+    else                                                                       \
+      PUSH(binaryHandler(TokenType::token, a, b)(a, b, heap));                 \
+  } while (false)
+
+#if LOX_COMPUTED_GOTO
+  static void *labels[] = {
+#define LOX_OPCODE_LABEL(name) &&op_##name,
+      LOX_OPCODES(LOX_OPCODE_LABEL)
+#undef LOX_OPCODE_LABEL
+  };
+// Leaving a handler this way skips the destructors of its locals, so
+// handlers keep to trivially destructible ones.
+#define DISPATCH() goto *labels[*ip++]
+#define CASE(name) op_##name:
+  DISPATCH();
+#else
+#define DISPATCH() continue
+#define CASE(name) case OpCode::name:
+  for (;;) {
+    switch (static_cast<OpCode>(*ip++)) {
+#endif
+
+  CASE(Constant) {
+    PUSH(constants[READ_SHORT()]);
+    DISPATCH();
+  }
+  CASE(Nil) {
+    PUSH(Value::nil());
+    DISPATCH();
+  }
+  CASE(True) {
+    PUSH(Value::boolean(true));
+    DISPATCH();
+  }
+  CASE(False) {
+    PUSH(Value::boolean(false));
+    DISPATCH();
+  }
+  CASE(Pop) {
+    --sp;
+    DISPATCH();
+  }
+  CASE(GetLocal) {
+    PUSH(slots[READ_SHORT()]);
+    DISPATCH();
+  }
+  CASE(SetLocal) {
+    slots[READ_SHORT()] = sp[-1];
+    DISPATCH();
+  }
+  CASE(GetEnv) {
+    uint16_t depth = READ_SHORT();
+    PUSH(frame->environment->at(depth, READ_SHORT()));
+    DISPATCH();
+  }
+  CASE(SetEnv) {
+    uint16_t depth = READ_SHORT();
+    frame->environment->at(depth, READ_SHORT()) = sp[-1];
+    DISPATCH();
+  }
+  CASE(GetGlobal) {
+    uint16_t index = READ_SHORT();
+    if (!globals.defined[index])
+      throw std::runtime_error("Undefined variable '" + globals.names[index] +
+                               "'.");
+    PUSH(globals.values[index]);
+    DISPATCH();
+  }
+  CASE(SetGlobal) {
+    uint16_t index = READ_SHORT();
+    if (!globals.defined[index])
+      throw std::runtime_error("Undefined variable '" + globals.names[index] +
+                               "'.");
+    globals.values[index] = sp[-1];
+    DISPATCH();
+  }
+  CASE(DefineGlobal) {
+    uint16_t index = READ_SHORT();
+    globals.values[index] = POP();
+    globals.defined[index] = true;
+    DISPATCH();
+  }
+  CASE(Reserve) {
+    uint16_t count = READ_SHORT();
+    sp = std::fill_n(sp, count, Value::nil());
+    DISPATCH();
+  }
+  CASE(Release) {
+    sp -= READ_SHORT();
+    DISPATCH();
+  }
+  CASE(PushEnv) {
+    uint16_t size = READ_SHORT();
+    frame->environment =
+        std::make_shared<Environment>(std::move(frame->environment), size);
+    DISPATCH();
+  }
+  CASE(PopEnv) {
+    frame->environment = frame->environment->enclosing;
+    DISPATCH();
+  }
+  CASE(Get) {
+    uint16_t site = READ_SHORT();
+    Value object = sp[-1];
+    if (!object.isInstance())
+      throw std::runtime_error("Only instances have properties.");
+    auto instance = object.asInstance();
+    auto &cache = frame->chunk->caches[site];
+    if (auto cached = cache.find(instance->shape, instance->klass->id)) {
+      sp[-1] = cached->slot >= 0 ? instance->field(cached->slot)
+                                 : Value::object(bind(cached->method, object));
+      DISPATCH();
+    }
+
+    // Fields shadow methods.
+    const auto &name = frame->chunk->names[site];
+    int slot = instance->shape->slotOf(name);
+    if (slot >= 0) {
+      cache.add({instance->shape, instance->shape, slot});
+      sp[-1] = instance->field(slot);
+      DISPATCH();
+    }
+    auto method = instance->klass->findMethod(name);
+    if (method == nullptr)
+      throw std::runtime_error("Undefined property '" + name + "'.");
+    cache.add(
+        {instance->shape, instance->shape, -1, instance->klass->id, method});
+    sp[-1] = Value::object(bind(method, object));
+    DISPATCH();
+  }
+  CASE(CheckInstance) {
+    if (!sp[-1].isInstance())
+      throw std::runtime_error("Only instances have fields.");
+    DISPATCH();
+  }
+  CASE(Set) {
+    uint16_t site = READ_SHORT();
+    Value value = POP();
+    auto instance = sp[-1].asInstance();
+    auto shape = instance->shape;
+    auto &cache = frame->chunk->caches[site];
+    if (auto cached = cache.find(shape)) {
+      if (cached->transition != shape)
+        instance->transition(cached->transition);
+      instance->field(cached->slot) = value;
+    } else {
+      const auto &name = frame->chunk->names[site];
+      instance->set(name, value);
+      cache.add({shape, instance->shape, instance->shape->slotOf(name)});
+    }
+    sp[-1] = value;
+    DISPATCH();
+  }
+  CASE(Super) {
+    uint16_t site = READ_SHORT();
+    uint16_t depth = READ_SHORT();
+    // `this` is bound in the frame just inside the one holding `super`.
+    auto superclass = frame->environment->at(depth, 0).asClass();
+    auto receiver = frame->environment->at(depth - 1, 0);
+    const auto &name = frame->chunk->names[site];
+    auto method = superclass->findMethod(name);
+    if (method == nullptr)
+      throw std::runtime_error("Undefined property '" + name + "'.");
+    PUSH(Value::object(bind(method, receiver)));
+    DISPATCH();
+  }
+  CASE(Equal) {
+    Value b = POP();
+    Value a = POP();
+    PUSH(Value::boolean(a == b));
+    DISPATCH();
+  }
+  CASE(NotEqual) {
+    Value b = POP();
+    Value a = POP();
+    PUSH(Value::boolean(!(a == b)));
+    DISPATCH();
+  }
+  CASE(Greater) {
+    BINARY(GREATER, Value::boolean, >);
+    DISPATCH();
+  }
+  CASE(GreaterEqual) {
+    BINARY(GREATER_EQUAL, Value::boolean, >=);
+    DISPATCH();
+  }
+  CASE(Less) {
+    BINARY(LESS, Value::boolean, <);
+    DISPATCH();
+  }
+  CASE(LessEqual) {
+    BINARY(LESS_EQUAL, Value::boolean, <=);
+    DISPATCH();
+  }
+  CASE(Add) {
+    BINARY(PLUS, Value::number, +);
+    DISPATCH();
+  }
+  CASE(Subtract) {
+    BINARY(MINUS, Value::number, -);
+    DISPATCH();
+  }
+  CASE(Multiply) {
+    BINARY(STAR, Value::number, *);
+    DISPATCH();
+  }
+  CASE(Divide) {
+    BINARY(SLASH, Value::number, /);
+    DISPATCH();
+  }
+  CASE(Not) {
+    Value value = POP();
+    if (!value.isBool())
+      throw std::runtime_error("Unary bang must be applied to a boolean");
+    PUSH(Value::boolean(!value.asBool()));
+    DISPATCH();
+  }
+  CASE(Negate) {
+    Value value = POP();
+    if (!value.isNumber())
+      throw std::runtime_error("Unary minus must be applied to a number");
+    PUSH(Value::number(-value.asNumber()));
+    DISPATCH();
+  }
+  CASE(Print) {
+    std::cout << to_string(POP()) << "\n";
+    DISPATCH();
+  }
+  CASE(Jump) {
+    uint16_t offset = READ_SHORT();
+    ip += offset;
+    DISPATCH();
+  }
+  CASE(JumpIfFalse) {
+    uint16_t offset = READ_SHORT();
+    if (POP().isFalsey())
+      ip += offset;
+    DISPATCH();
+  }
+  CASE(And) {
+    uint16_t offset = READ_SHORT();
+    if (sp[-1].isFalsey())
+      ip += offset;
+    else
+      --sp;
+    DISPATCH();
+  }
+  CASE(Or) {
+    uint16_t offset = READ_SHORT();
+    if (!sp[-1].isFalsey())
+      ip += offset;
+    else
+      --sp;
+    DISPATCH();
+  }
+  CASE(Loop) {
+    uint16_t offset = READ_SHORT();
+    ip -= offset;
+    if (heap.shouldCollect())
+      collectGarbage();
+    DISPATCH();
+  }
+  CASE(Check) {
+    if (frame->base + READ_SHORT() > maxDepth)
+      throw std::runtime_error("Expression nesting too deep");
+    DISPATCH();
+  }
+  CASE(CheckCall) {
+    uint16_t count = READ_SHORT();
+    Value callee = sp[-1];
+    const Function *declaration;
+    if (callee.isFunction()) {
+      declaration = callee.asFunction()->declaration;
+    } else if (callee.isClass()) {
+      auto initializer = callee.asClass()->initializer;
+      declaration = initializer ? initializer->declaration : nullptr;
+    } else {
+      throw std::runtime_error("Can only call functions and classes.");
+    }
+    auto arity = declaration ? declaration->params.size() : 0;
+    if (count != arity)
+      throw std::runtime_error("Expected " + std::to_string(arity) +
+                               " arguments but got " + std::to_string(count) +
+                               ".");
+    DISPATCH();
+  }
+  CASE(Call) {
+    uint16_t count = READ_SHORT();
+    uint16_t level = READ_SHORT();
+    call(count, frame->base + level);
+    DISPATCH();
+  }
+  CASE(TailCall) {
+    uint16_t count = READ_SHORT();
+    Value callee = sp[-count - 1];
+    if (!callee.isFunction()) {
+      call(count, frame->base);
+      DISPATCH();
+    }
+    // The callee and its arguments replace the current call's.
+    auto arguments = frame->slots;
+    auto base = frame->base;
+    std::copy(sp - count - 1, sp, stack.data() + arguments - 1);
+    sp = stack.data() + arguments + count;
+    frames.pop_back();
+    enter(callee.asFunction(), arguments, count, base);
+    LOAD_FRAME();
+    DISPATCH();
+  }
+  CASE(Closure) {
+    const auto *body = frame->chunk->functions[READ_SHORT()];
+    auto function = heap.allocate<ObjFunction>(body->declaration,
+                                               frame->environment, false);
+    function->chunk = body;
+    PUSH(Value::object(function));
+    DISPATCH();
+  }
+  CASE(Class) {
+    const auto &code = frame->chunk->classes[READ_SHORT()];
+    const auto &declaration = *code.declaration;
+    ObjClass *superclass = nullptr;
+    if (declaration.superclass) {
+      Value value = POP();
+      if (!value.isClass())
+        throw std::runtime_error("Superclass must be a class.");
+      superclass = value.asClass();
+    }
+    PUSH(Value::object(makeClass(code, superclass, frame->environment)));
+    DISPATCH();
+  }
+  CASE(Return) {
+    Value result = POP();
+    if (frames.size() == 1)
+      return result;
+    // An initializer always returns the instance, bound at slot 0 of its
+    // closure.
+    if (frame->function->isInitializer)
+      result = frame->function->closure->slots[0];
+    sp = slots - 1;
+    frames.pop_back();
+    LOAD_FRAME();
+    PUSH(result);
+    DISPATCH();
+  }
+
+#if !LOX_COMPUTED_GOTO
+    }
+  }
+#endif
+
+#undef CASE
+#undef DISPATCH
+#undef BINARY
+#undef LOAD_FRAME
+#undef POP
+#undef PUSH
+#undef READ_SHORT
+}
+} // namespace Lox
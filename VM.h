@@ -0,0 +1,93 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+#ifndef LOX_VM_H
+#define LOX_VM_H
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "Chunk.h"
+#include "Compiler.h"
+#include "Environment.h"
+#include "Expr.h"
+#include "Lox.h"
+#include "Resolver.h"
+#include "Statement.h"
+#include "Value.h"
+
+namespace Lox {
+
+// Stack-based bytecode virtual machine, an alternative to the tree-walking
+// Interpreter that produces the same results and runtime errors.
+class VM {
+  // A running call. Its arguments and other stack locals start at index
+  // `slots` of the stack, just past the callee; `base` is the expression
+  // depth it runs at.
+  struct CallFrame {
+    const Chunk *chunk;
+    const uint8_t *ip;
+    std::size_t slots;
+    ObjFunction *function;
+    std::shared_ptr<Environment> environment;
+    int base;
+  };
+
+  Heap heap;
+  Globals globals;
+  // The compiled function bodies, which live as long as the VM: functions
+  // declared by one program can be called from the next.
+  std::vector<std::unique_ptr<Chunk>> bodies;
+  std::vector<Value> stack;
+  std::vector<CallFrame> frames;
+  int maxDepth;
+
+  // A copy of `method` whose closure binds `this` to `receiver`.
+  ObjFunction *bind(ObjFunction *method, Value receiver) {
+    auto frame = std::make_shared<Environment>(method->closure, 1);
+    frame->slots[0] = receiver;
+    auto bound = heap.allocate<ObjFunction>(
+        method->declaration, std::move(frame), method->isInitializer);
+    bound->chunk = method->chunk;
+    return bound;
+  }
+
+  // A new class with the methods of `code`, closing over `environment`.
+  ObjClass *makeClass(const ClassCode &code, ObjClass *superclass,
+                      const std::shared_ptr<Environment> &environment);
+
+public:
+  explicit VM(int maxDepth = 10000) : maxDepth(maxDepth) {}
+
+  Chunk compile(const Expr *expr) {
+    return Compiler(heap, globals, bodies, maxDepth).compileExpression(expr);
+  }
+
+  // Resolves and compiles a program. Resolution errors are reported through
+  // Lox::error and leave nothing to run.
+  std::optional<Chunk>
+  compile(const std::vector<std::shared_ptr<Statement>> &statements) {
+    Resolver resolver;
+    resolver.resolve(statements);
+    if (Lox::hadError)
+      return std::nullopt;
+    return Compiler(heap, globals, bodies, maxDepth)
+        .compileStatements(statements);
+  }
+
+  LoxValue interpret(const Expr *expr) { return toLoxValue(run(compile(expr))); }
+
+  void interpret(const std::vector<std::shared_ptr<Statement>> &statements) {
+    if (auto chunk = compile(statements))
+      run(*chunk);
+  }
+
+  // Runtime errors are thrown as std::runtime_error.
+  Value run(const Chunk &chunk);
+};
+} // namespace Lox
+
+#endif // LOX_VM_H
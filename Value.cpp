@@ -0,0 +1,191 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+#include <charconv>
+#include <cmath>
+#include <vector>
+
+#include "Value.h"
+#include "Environment.h"
+#include "Statement.h"
+
+namespace Lox {
+void ObjString::flatten() {
+  // Walk the leaves left to right with an explicit stack: ropes built by
+  // repeated appends are as deep as the number of appends.
+  std::string result;
+  result.reserve(length);
+  std::vector<const ObjString *> pending{this};
+  while (!pending.empty()) {
+    auto node = pending.back();
+    pending.pop_back();
+    if (node->isRope()) {
+      pending.push_back(node->right);
+      pending.push_back(node->left);
+    } else {
+      result += node->flat;
+    }
+  }
+  flat = std::move(result);
+  left = right = nullptr;
+}
+
+// Only counts what is fixed when the object is allocated, so the amount
+// added by allocate() is exactly what sweep() subtracts.
+std::size_t footprint(const Obj *obj) {
+  switch (obj->type) {
+  case ObjType::String:
+    return sizeof(ObjString) + static_cast<const ObjString *>(obj)->length;
+  case ObjType::Class:
+    return sizeof(ObjClass);
+  case ObjType::Instance:
+    return sizeof(ObjInstance);
+  case ObjType::Function:
+    return sizeof(ObjFunction);
+  }
+  return 0;
+}
+
+void Heap::mark(Environment *environment) {
+  for (; environment != nullptr && environment->epoch != epoch;
+       environment = environment->enclosing.get()) {
+    environment->epoch = epoch;
+    for (auto value : environment->slots)
+      mark(value);
+  }
+}
+
+void Heap::traceReferences() {
+  while (!gray.empty()) {
+    auto obj = gray.back();
+    gray.pop_back();
+    switch (obj->type) {
+    case ObjType::String: {
+      auto string = static_cast<ObjString *>(obj);
+      mark(string->left);
+      mark(string->right);
+      break;
+    }
+    case ObjType::Class: {
+      auto klass = static_cast<ObjClass *>(obj);
+      mark(klass->superclass);
+      for (const auto &[name, method] : klass->methods)
+        mark(method);
+      mark(klass->initializer);
+      break;
+    }
+    case ObjType::Instance: {
+      auto instance = static_cast<ObjInstance *>(obj);
+      mark(instance->klass);
+      for (int slot = 0; slot < instance->shape->fieldCount(); ++slot)
+        mark(instance->field(slot));
+      break;
+    }
+    case ObjType::Function:
+      mark(static_cast<ObjFunction *>(obj)->closure.get());
+      break;
+    }
+  }
+}
+
+void Heap::sweep() {
+  std::erase_if(strings, [](const auto &entry) {
+    return !entry.second->marked;
+  });
+
+  Obj **link = &objects;
+  while (*link != nullptr) {
+    Obj *obj = *link;
+    if (obj->marked) {
+      obj->marked = false;
+      link = &obj->next;
+    } else {
+      *link = obj->next;
+      bytesAllocated -= footprint(obj);
+      delete obj;
+    }
+  }
+}
+
+Value toValue(const LoxValue &value, Heap &heap) {
+  return std::visit(
+      [&](const auto &v) {
+        using T = std::decay_t<decltype(v)>;
+        if constexpr (std::is_same_v<T, double>) {
+          return Value::number(v);
+        } else if constexpr (std::is_same_v<T, std::string>) {
+          return heap.string(v);
+        } else if constexpr (std::is_same_v<T, bool>) {
+          return Value::boolean(v);
+        } else {
+          return Value::nil();
+        }
+      },
+      value);
+}
+
+Value Heap::constant(const LoxValue &value) {
+  auto constant = toValue(value, *this);
+  constants.push_back(constant);
+  return constant;
+}
+
+LoxValue toLoxValue(Value value) {
+  if (value.isNumber())
+    return value.asNumber();
+  if (value.isBool())
+    return value.asBool();
+  if (value.isString())
+    return value.asString()->chars();
+  if (value.isObject())
+    return to_string(value);
+  return nullptr;
+}
+
+// Whole numbers are written out in full, as 1000000 rather than 1e+06, up
+// to 1e21 where that stops being readable; others take the shortest form
+// that reads back as the same double.
+static std::string numberToString(double number) {
+  char buffer[32];
+  auto [end, ec] =
+      std::trunc(number) == number && std::fabs(number) < 1e21
+          ? std::to_chars(buffer, buffer + sizeof(buffer), number,
+                          std::chars_format::fixed)
+          : std::to_chars(buffer, buffer + sizeof(buffer), number);
+  return {buffer, end};
+}
+
+std::string to_string(Value value) {
+  if (value.isNumber())
+    return numberToString(value.asNumber());
+  if (value.isBool())
+    return value.asBool() ? "true" : "false";
+  if (value.isString())
+    return value.asString()->chars();
+  if (value.isClass())
+    return value.asClass()->name;
+  if (value.isInstance())
+    return value.asInstance()->klass->name + " instance";
+  if (value.isFunction())
+    return "<fn " + value.asFunction()->declaration->name.getLexeme() + ">";
+  return "nil";
+}
+
+std::string to_string(const LoxValue &value) {
+  return std::visit(
+      [](const auto &v) -> std::string {
+        using T = std::decay_t<decltype(v)>;
+        if constexpr (std::is_same_v<T, double>) {
+          return numberToString(v);
+        } else if constexpr (std::is_same_v<T, std::string>) {
+          return v;
+        } else if constexpr (std::is_same_v<T, bool>) {
+          return v ? "true" : "false";
+        } else {
+          return "nil";
+        }
+      },
+      value);
+}
+} // namespace Lox
@@ -0,0 +1,476 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+#ifndef LOX_VALUE_H
+#define LOX_VALUE_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "Shape.h"
+
+namespace Lox {
+struct Chunk;
+struct Function;
+class Environment;
+
+using LoxValue = std::variant<double, std::string, bool, std::nullptr_t>;
+
+enum class ObjType { String, Class, Instance, Function };
+
+// Dynamic type of a Value, dense so it can index dispatch tables. Object
+// tags follow the order of ObjType, starting at String.
+enum class ValueTag { Number, Nil, Bool, String, Class, Instance, Function };
+
+inline constexpr std::size_t valueTagCount =
+    static_cast<std::size_t>(ValueTag::Function) + 1;
+
+// Base of every heap-allocated runtime object. Objects are owned by the Heap
+// that allocated them and chained through `next` so it can sweep them.
+struct Obj {
+  ObjType type;
+  bool marked = false;
+  Obj *next = nullptr;
+
+  explicit Obj(ObjType type) : type(type) {}
+  virtual ~Obj() = default;
+};
+
+// FNV-1a, the hash used for strings throughout the runtime.
+inline uint64_t hashString(std::string_view chars) {
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : chars) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+// An immutable string, stored either flat or as a rope: the concatenation
+// of two other strings. Concatenating long strings builds a rope node in
+// O(1); its characters are copied out only the first time they are needed,
+// so a loop that repeatedly appends to a string stays linear overall.
+struct ObjString : public Obj {
+  // Concatenations shorter than this are copied straight into a flat string.
+  static constexpr std::size_t minRopeLength = 64;
+
+  explicit ObjString(std::string chars)
+      : Obj(ObjType::String), length(chars.size()), flat(std::move(chars)) {}
+
+  ObjString(ObjString *left, ObjString *right)
+      : Obj(ObjType::String), length(left->length + right->length),
+        left(left), right(right) {}
+
+  const std::size_t length;
+
+  [[nodiscard]] bool isRope() const { return left != nullptr; }
+
+  // The characters of the string, flattening it first if it is a rope.
+  const std::string &chars() {
+    if (isRope())
+      flatten();
+    return flat;
+  }
+
+  // Computed the first time it is asked for, then cached.
+  uint64_t hash() {
+    if (!hashed) {
+      hashValue = hashString(chars());
+      hashed = true;
+    }
+    return hashValue;
+  }
+
+  // Two interned strings are equal exactly when they are the same object;
+  // otherwise cached hashes rule out most mismatches before any characters
+  // are compared.
+  bool equals(ObjString *other) {
+    if (this == other)
+      return true;
+    if (interned && other->interned)
+      return false;
+    return length == other->length && hash() == other->hash() &&
+           chars() == other->chars();
+  }
+
+private:
+  friend class Heap;
+
+  std::string flat;
+  ObjString *left = nullptr;
+  ObjString *right = nullptr;
+  uint64_t hashValue = 0;
+  bool hashed = false;
+  bool interned = false;
+
+  void flatten();
+};
+
+// A function or method together with the frame it closes over.
+struct ObjFunction : public Obj {
+  const Function *declaration;
+  std::shared_ptr<Environment> closure;
+  bool isInitializer;
+  // The compiled body, for functions created by the VM.
+  const Chunk *chunk = nullptr;
+
+  ObjFunction(const Function *declaration,
+              std::shared_ptr<Environment> closure, bool isInitializer)
+      : Obj(ObjType::Function), declaration(declaration),
+        closure(std::move(closure)), isInitializer(isInitializer) {}
+};
+
+// A class's method table is flattened: it is created as a copy of the
+// superclass's table with the class's own methods written over it, so
+// finding a method is one hash lookup however deep the hierarchy is.
+struct ObjClass : public Obj {
+  std::string name;
+  ObjClass *superclass;
+  std::unordered_map<std::string, ObjFunction *> methods;
+  ObjFunction *initializer = nullptr;
+  // Unique for the life of the process, unlike the object's address, so
+  // inline caches can key on it.
+  uint64_t id;
+
+  ObjClass(std::string name, ObjClass *superclass)
+      : Obj(ObjType::Class), name(std::move(name)), superclass(superclass),
+        id(++lastId) {
+    if (superclass != nullptr) {
+      methods = superclass->methods;
+      initializer = superclass->initializer;
+    }
+  }
+
+  void addMethod(const std::string &method, ObjFunction *function) {
+    methods[method] = function;
+    if (method == "init")
+      initializer = function;
+  }
+
+  [[nodiscard]] ObjFunction *findMethod(const std::string &method) const {
+    auto found = methods.find(method);
+    return found == methods.end() ? nullptr : found->second;
+  }
+
+private:
+  inline static uint64_t lastId = 0;
+};
+
+struct ObjInstance;
+
+// A Lox value packed into 8 bytes using NaN-boxing.
+//
+// Any bit pattern that is not a quiet NaN with the QNAN bits set is a plain
+// double. Otherwise the low bits hold a tag for nil/false/true, or - when
+// the sign bit is also set - a pointer to an Obj. Values are trivially
+// copyable and are passed around in a single general purpose register.
+class Value {
+  static constexpr uint64_t SIGN_BIT = 0x8000000000000000;
+  static constexpr uint64_t QNAN = 0x7ffc000000000000;
+  static constexpr uint64_t TAG_NIL = 1;
+  static constexpr uint64_t TAG_FALSE = 2;
+  static constexpr uint64_t TAG_TRUE = 3;
+
+  uint64_t bits;
+
+  explicit constexpr Value(uint64_t bits) : bits(bits) {}
+
+public:
+  constexpr Value() : bits(QNAN | TAG_NIL) {}
+
+  static constexpr Value nil() { return Value(QNAN | TAG_NIL); }
+
+  static constexpr Value boolean(bool value) {
+    return Value(QNAN | (value ? TAG_TRUE : TAG_FALSE));
+  }
+
+  static Value number(double value) {
+    // Canonicalize NaNs so no arithmetic result can alias a tagged value.
+    if (value != value)
+      value = std::numeric_limits<double>::quiet_NaN();
+    return Value(std::bit_cast<uint64_t>(value));
+  }
+
+  static Value object(Obj *obj) {
+    return Value(SIGN_BIT | QNAN | reinterpret_cast<uintptr_t>(obj));
+  }
+
+  [[nodiscard]] bool isNumber() const { return (bits & QNAN) != QNAN; }
+  [[nodiscard]] bool isNil() const { return bits == (QNAN | TAG_NIL); }
+  [[nodiscard]] bool isBool() const { return (bits | 1) == (QNAN | TAG_TRUE); }
+  [[nodiscard]] bool isObject() const {
+    return (bits & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT);
+  }
+  [[nodiscard]] bool isString() const {
+    return isObject() && asObject()->type == ObjType::String;
+  }
+  [[nodiscard]] bool isClass() const {
+    return isObject() && asObject()->type == ObjType::Class;
+  }
+  [[nodiscard]] bool isInstance() const {
+    return isObject() && asObject()->type == ObjType::Instance;
+  }
+  [[nodiscard]] bool isFunction() const {
+    return isObject() && asObject()->type == ObjType::Function;
+  }
+
+  // nil and false are falsey; every other value is truthy.
+  [[nodiscard]] bool isFalsey() const {
+    return bits == (QNAN | TAG_NIL) || bits == (QNAN | TAG_FALSE);
+  }
+
+  [[nodiscard]] ValueTag tag() const {
+    if (isNumber())
+      return ValueTag::Number;
+    if (isObject())
+      return static_cast<ValueTag>(static_cast<int>(ValueTag::String) +
+                                   static_cast<int>(asObject()->type));
+    return isNil() ? ValueTag::Nil : ValueTag::Bool;
+  }
+
+  [[nodiscard]] double asNumber() const { return std::bit_cast<double>(bits); }
+  [[nodiscard]] bool asBool() const { return bits == (QNAN | TAG_TRUE); }
+  [[nodiscard]] Obj *asObject() const {
+    return reinterpret_cast<Obj *>(
+        static_cast<uintptr_t>(bits & ~(SIGN_BIT | QNAN)));
+  }
+  [[nodiscard]] ObjString *asString() const {
+    return static_cast<ObjString *>(asObject());
+  }
+  [[nodiscard]] ObjClass *asClass() const {
+    return static_cast<ObjClass *>(asObject());
+  }
+  [[nodiscard]] ObjInstance *asInstance() const;
+  [[nodiscard]] ObjFunction *asFunction() const {
+    return static_cast<ObjFunction *>(asObject());
+  }
+
+  // Lox equality: numbers compare as doubles, strings by content, and
+  // everything else by identity.
+  friend bool operator==(Value a, Value b) {
+    if (a.isNumber() && b.isNumber())
+      return a.asNumber() == b.asNumber();
+    if (a.isString() && b.isString())
+      return a.asString()->equals(b.asString());
+    return a.bits == b.bits;
+  }
+};
+
+static_assert(sizeof(Value) == 8);
+static_assert(std::is_trivially_copyable_v<Value>);
+
+// An instance's fields are laid out by its Shape. The first few live inline
+// in the object; any beyond that spill into a separate array.
+struct ObjInstance : public Obj {
+  static constexpr int inlineFieldCount = 4;
+
+  ObjClass *klass;
+  Shape *shape;
+  std::array<Value, inlineFieldCount> inlineFields;
+  std::vector<Value> extraFields;
+
+  ObjInstance(ObjClass *klass, Shape *shape)
+      : Obj(ObjType::Instance), klass(klass), shape(shape) {}
+
+  Value &field(int slot) {
+    return slot < inlineFieldCount ? inlineFields[slot]
+                                   : extraFields[slot - inlineFieldCount];
+  }
+
+  // Moves to `next`, a shape that extends the current one by one field.
+  void transition(Shape *next) {
+    shape = next;
+    if (next->fieldCount() > inlineFieldCount)
+      extraFields.emplace_back();
+  }
+
+  bool get(const std::string &name, Value &value) {
+    int slot = shape->slotOf(name);
+    if (slot < 0)
+      return false;
+    value = field(slot);
+    return true;
+  }
+
+  void set(const std::string &name, Value value) {
+    int slot = shape->slotOf(name);
+    if (slot < 0) {
+      transition(shape->withField(name));
+      slot = shape->fieldCount() - 1;
+    }
+    field(slot) = value;
+  }
+};
+
+inline ObjInstance *Value::asInstance() const {
+  return static_cast<ObjInstance *>(asObject());
+}
+
+// When a Heap collects garbage.
+struct GcPolicy {
+  // Bytes that may be allocated before the first collection, and the
+  // smallest threshold ever used.
+  std::size_t initialThreshold = 1 << 20;
+  // After a collection the next one happens once the heap has grown to
+  // this multiple of what survived.
+  double growthFactor = 2.0;
+};
+
+// Approximate number of bytes `obj` keeps alive, used to pace collection.
+std::size_t footprint(const Obj *obj);
+
+// Owns every object allocated through it.
+//
+// Unreachable objects are reclaimed by a precise mark-sweep collector. The
+// heap cannot see its owner's variables, so collection only happens when
+// the owner calls collect() at a point where it can name every live value;
+// allocation itself never collects. The interned string table is weak, and
+// the constant pool is always a root.
+class Heap {
+  struct StringHash {
+    std::size_t operator()(std::string_view chars) const {
+      return hashString(chars);
+    }
+  };
+
+  Obj *objects = nullptr;
+  // Every interned string, keyed by a view of its own characters.
+  std::unordered_map<std::string_view, ObjString *, StringHash> strings;
+  // Values of the literals evaluated against this heap. They are immutable
+  // and live as long as the heap.
+  std::vector<Value> constants;
+
+  GcPolicy policy;
+  std::size_t bytesAllocated = 0;
+  std::size_t nextCollection;
+  // Environments are not heap objects; each collection has its own epoch
+  // and an environment is marked by stamping it with the current one.
+  uint64_t epoch = 0;
+  std::vector<Obj *> gray;
+
+  inline static uint64_t lastId = 0;
+
+  void traceReferences();
+  void sweep();
+
+public:
+  // Identifies this heap, and so its constant pool; never reused.
+  const uint64_t id = ++lastId;
+
+  explicit Heap(GcPolicy policy = {})
+      : policy(policy), nextCollection(policy.initialThreshold) {}
+  Heap(const Heap &) = delete;
+  Heap &operator=(const Heap &) = delete;
+
+  ~Heap() {
+    while (objects != nullptr) {
+      Obj *next = objects->next;
+      delete objects;
+      objects = next;
+    }
+  }
+
+  template <typename T, typename... Args> T *allocate(Args &&...args) {
+    auto obj = new T(std::forward<Args>(args)...);
+    obj->next = objects;
+    objects = obj;
+    bytesAllocated += footprint(obj);
+    return obj;
+  }
+
+  [[nodiscard]] std::size_t size() const { return bytesAllocated; }
+
+  // Whether enough has been allocated since the last collection that the
+  // owner should collect at its next safe point.
+  [[nodiscard]] bool shouldCollect() const {
+#ifdef LOX_GC_STRESS
+    return true;
+#else
+    return bytesAllocated > nextCollection;
+#endif
+  }
+
+  // Frees every object not reachable from the constant pool or from the
+  // roots that `markRoots(*this)` passes to mark().
+  template <typename F> void collect(F &&markRoots) {
+    ++epoch;
+    for (auto constant : constants)
+      mark(constant);
+    markRoots(*this);
+    traceReferences();
+    sweep();
+    nextCollection = std::max(
+        policy.initialThreshold,
+        static_cast<std::size_t>(bytesAllocated * policy.growthFactor));
+  }
+
+  void mark(Obj *obj) {
+    if (obj == nullptr || obj->marked)
+      return;
+    obj->marked = true;
+    gray.push_back(obj);
+  }
+
+  void mark(Value value) {
+    if (value.isObject())
+      mark(value.asObject());
+  }
+
+  // Marks the values in `environment` and every frame enclosing it.
+  void mark(Environment *environment);
+
+  // The interned string with contents `chars`. Literals and short computed
+  // strings are interned, so equal ones share a single object.
+  Value string(std::string_view chars) {
+    auto found = strings.find(chars);
+    if (found != strings.end())
+      return Value::object(found->second);
+    auto obj = allocate<ObjString>(std::string(chars));
+    obj->interned = true;
+    strings.emplace(obj->flat, obj);
+    return Value::object(obj);
+  }
+
+  // Results long enough to become ropes are left uninterned: interning
+  // would flatten them.
+  Value concatenate(ObjString *left, ObjString *right) {
+    if (left->length + right->length < ObjString::minRopeLength)
+      return string(left->chars() + right->chars());
+    return Value::object(allocate<ObjString>(left, right));
+  }
+
+  // Adds the value of a literal to the constant pool.
+  Value constant(const LoxValue &value);
+
+  // A new instance with no fields, at the root of the shape tree.
+  Value instance(ObjClass *klass) {
+    return Value::object(allocate<ObjInstance>(klass, Shape::root()));
+  }
+};
+
+// Conversions between the variant-based LoxValue and Value.
+Value toValue(const LoxValue &value, Heap &heap);
+LoxValue toLoxValue(Value value);
+
+// toLoxValue() represents objects other than strings by their printed form.
+
+// The text `print` shows for a value. Numbers use the shortest
+// representation that round-trips.
+std::string to_string(Value value);
+std::string to_string(const LoxValue &value);
+} // namespace Lox
+
+#endif // LOX_VALUE_H
@@ -4,32 +4,128 @@
 #include <iostream>
 
 #include "ASTPrinter.h"
+#include "ClosureCompiler.h"
+#include "CppEmitter.h"
 #include "Interpreter.h"
+#include "IrLowering.h"
+#include "IrOptimizer.h"
 #include "Parser.h"
+#include "Resolver.h"
 #include "Scanner.h"
 #include "Token.h"
+#include "VM.h"
 
 bool global_debug_flag = false;
+std::string global_backend = "interpreter";
+Lox::JitPolicy global_jit;
+bool global_emit_cpp = false;
+bool global_dump_ir = false;
+
+// Every program parsed is kept alive for the rest of the session: the
+// functions and classes it declares refer to their declarations after it has
+// run, from later lines at the prompt.
+std::vector<std::vector<std::shared_ptr<Lox::Statement>>> programs;
+
+// Runs `statements` on the selected backend. The backend is created once, so
+// globals defined at the prompt stay defined on later lines.
+void execute(const std::vector<std::shared_ptr<Lox::Statement>> &statements) {
+  if (global_backend == "closure") {
+    static Lox::ClosureCompiler compiler;
+    compiler.interpret(statements);
+    return;
+  }
+
+  if (global_backend == "vm") {
+    static Lox::VM vm;
+    auto chunk = vm.compile(statements);
+    if (!chunk) {
+      return;
+    }
+    if (global_debug_flag) {
+      std::cout << "======== Bytecode ========\n";
+      Lox::disassemble(*chunk, std::cout);
+    }
+    vm.run(*chunk);
+    return;
+  }
+
+  static Lox::Interpreter interpreter(10000, {}, global_jit);
+  interpreter.interpret(statements);
+}
 
-void run(std::string_view source) {
+// Prints the optimized IR of each global function in `statements`.
+void dumpIr(const std::vector<std::shared_ptr<Lox::Statement>> &statements) {
+  Lox::Resolver resolver;
+  resolver.resolve(statements);
+  if (Lox::Lox::hadError) {
+    return;
+  }
+  for (const auto &statement : statements) {
+    auto function = dynamic_cast<const Lox::Function *>(statement.get());
+    if (!function) {
+      continue;
+    }
+    try {
+      auto ir = Lox::IrLowering(10000, resolver.constantFunctions())
+                    .lower(*function);
+      Lox::IrOptimizer(ir).run();
+      Lox::dump(ir, std::cout);
+    } catch (const Lox::IrLowering::Unsupported &) {
+      std::cout << "; " << function->name.getLexeme()
+                << ": not supported by the IR\n";
+    }
+  }
+}
+
+// `prompt` is set for a line typed at the REPL, whose last expression may
+// leave out its ';' to have its value printed.
+void run(std::string_view source, bool prompt = false) {
   if (global_debug_flag) {
     std::cout << "Running program " << source << "\n";
+  }
+
+  // Errors are per run: a mistake on one prompt line must not stop the
+  // lines after it from running.
+  Lox::Lox::hadError = false;
+  Lox::Lox::hadRuntimeError = false;
+
+  Lox::Scanner scanner(std::string(source.begin(), source.end()));
+  std::vector<Lox::Token> tokens = scanner.scanTokens();
+  Lox::Parser parser(tokens);
+  auto statements = prompt ? parser.parseRepl() : parser.parse();
+  if (Lox::Lox::hadError) {
+    return;
+  }
 
-    Lox::Scanner scanner(std::string(source.begin(), source.end()));
-    std::vector<Lox::Token> tokens = scanner.scanTokens();
-    Lox::Parser parser(tokens);
-    auto expr = parser.parse();
+  if (global_debug_flag) {
     Lox::ASTPrinter printer;
     std::cout << "======== Parser ========\n";
-    std::cout << printer.print(expr.get()) << "\n";
-    std::cout << "======== Interpreter ========\n";
-    //    Lox::Interpreter interpreter;
-    //    interpreter.interpret(expr.get());
+    printer.print(statements, std::cout);
+  }
+
+  if (global_emit_cpp) {
+    Lox::CppEmitter().emit(statements, std::cout);
+    return;
+  }
+
+  if (global_dump_ir) {
+    dumpIr(statements);
+    return;
+  }
 
-    //  if (global_debug_flag) {
-    //    std::cout << "======== Scanner ========\n"
-    //              << Lox::to_string(tokens) << "\n";
-    //  }
+  programs.push_back(statements);
+  try {
+    if (global_debug_flag) {
+      std::cout << "======== Interpreter ========\n";
+    }
+    execute(statements);
+    if (global_debug_flag) {
+      std::cout << "======== Inline caches ========\n"
+                << "hits: " << Lox::inlineCacheStats.hits
+                << ", misses: " << Lox::inlineCacheStats.misses << "\n";
+    }
+  } catch (const std::runtime_error &e) {
+    Lox::Lox::runtimeError(e.what());
   }
 }
 
@@ -38,7 +134,7 @@ void runFile(std::string_view path) {
     std::cout << "Evaluating file " << path << "\n";
   }
 
-  std::ifstream file(path);
+  std::ifstream file{std::string(path)};
   std::string content((std::istreambuf_iterator<char>(file)),
                       (std::istreambuf_iterator<char>()));
   if (content.empty()) {
@@ -47,6 +143,12 @@ void runFile(std::string_view path) {
     exit(1);
   }
   run(content);
+  if (Lox::Lox::hadError) {
+    exit(65);
+  }
+  if (Lox::Lox::hadRuntimeError) {
+    exit(70);
+  }
 }
 
 void runPrompt() {
@@ -68,7 +170,7 @@ void runPrompt() {
       break;
     }
 
-    run(input_as_string);
+    run(input_as_string, true);
   }
 }
 
@@ -78,11 +180,33 @@ int main(int argc, char **argv) {
   auto flag =
       parser.AddFlag("global_debug_flag", 'd', "Enable global_debug_flag mode");
   auto file = parser.AddArg<std::string>("file", "Path to file to run");
+  auto backend = parser
+                     .AddArg<std::string>(
+                         "backend", 'b',
+                         "Execution backend: interpreter, vm or closure")
+                     .Options({"interpreter", "vm", "closure"})
+                     .Default("interpreter");
+  auto noJit = parser.AddFlag(
+      "no-jit", "Run every function in the interpreter, compiling none");
+  auto emitCpp = parser.AddFlag(
+      "emit-cpp", "Print a C++ program that runs the input, instead of it");
+  auto dumpIr = parser.AddFlag(
+      "dump-ir", "Print the input's optimized IR, instead of running it");
 
   parser.ParseArgs(argc, argv);
   if (*flag) {
     global_debug_flag = true;
   }
+  global_backend = *backend;
+  if (*noJit) {
+    global_jit.enabled = false;
+  }
+  if (*emitCpp) {
+    global_emit_cpp = true;
+  }
+  if (*dumpIr) {
+    global_dump_ir = true;
+  }
   if (file) {
     runFile(*file);
   } else {
@@ -0,0 +1,80 @@
+//
+// Created by Bob Fang on 10/18/26.
+//
+
+// Evaluates a numeric expression in the Interpreter many times, and reports
+// the heap allocations made per Binary node evaluated and the time each
+// evaluation takes. Fails unless there are no allocations at all: operands
+// are evaluated to Values, with no std::any boxing in between.
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+
+#include "Interpreter.h"
+#include "Parser.h"
+#include "Scanner.h"
+#include "Statement.h"
+
+namespace {
+std::size_t allocations = 0;
+
+// The number of Binary nodes in `expr`, which must only contain Binary,
+// Grouping and Literal nodes.
+int binaries(const Lox::Expr *expr) {
+  if (auto binary = dynamic_cast<const Lox::Binary *>(expr))
+    return 1 + binaries(binary->left.get()) + binaries(binary->right.get());
+  if (auto grouping = dynamic_cast<const Lox::Grouping *>(expr))
+    return binaries(grouping->expression.get());
+  return 0;
+}
+} // namespace
+
+void *operator new(std::size_t size) {
+  ++allocations;
+  if (auto memory = std::malloc(size))
+    return memory;
+  throw std::bad_alloc();
+}
+
+// Not inlined, so that GCC does not take the free() for one that does not
+// match a new expression.
+[[gnu::noinline]] void operator delete(void *memory) noexcept {
+  std::free(memory);
+}
+
+[[gnu::noinline]] void operator delete(void *memory, std::size_t) noexcept {
+  std::free(memory);
+}
+
+int main() {
+  constexpr int evaluations = 1000000;
+
+  Lox::Scanner scanner("(1 + 2) * 3 - 4 / 2 > 6 == (7 <= 8 * 9 - 10);");
+  Lox::Parser parser(scanner.scanTokens());
+  auto statements = parser.parse();
+  auto expression =
+      std::static_pointer_cast<Lox::Expression>(statements.front())
+          ->expression;
+  Lox::Interpreter interpreter;
+
+  // The first evaluation may size the Interpreter's stacks.
+  interpreter.interpret(expression.get());
+  auto before = allocations;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < evaluations; ++i)
+    interpreter.interpret(expression.get());
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  auto made = allocations - before;
+
+  auto nodes = static_cast<double>(binaries(expression.get())) * evaluations;
+  std::cout << "allocations per Binary evaluation: "
+            << static_cast<double>(made) / nodes << "\n"
+            << "nanoseconds per Binary evaluation: "
+            << std::chrono::duration<double, std::nano>(elapsed).count() /
+                   nodes
+            << "\n";
+  return made == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
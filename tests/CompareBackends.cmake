@@ -0,0 +1,29 @@
+# Runs a Lox program on every backend and fails unless each one prints what
+# the .out file next to the program expects: its standard output, then its
+# standard error.
+#
+#   cmake -DLOX=<lox executable> -DPROGRAM=<program.lox> \
+#         -P CompareBackends.cmake
+
+get_filename_component(directory "${PROGRAM}" DIRECTORY)
+get_filename_component(name "${PROGRAM}" NAME_WE)
+file(READ "${directory}/${name}.out" expected)
+
+# `no-jit` is the Interpreter with every function left to the tree-walker.
+foreach(backend interpreter no-jit vm closure)
+  if(backend STREQUAL "no-jit")
+    set(arguments --no-jit)
+  else()
+    set(arguments -b ${backend})
+  endif()
+  execute_process(
+          COMMAND "${LOX}" ${arguments} --file "${PROGRAM}"
+          OUTPUT_VARIABLE output
+          ERROR_VARIABLE error)
+  if(NOT "${output}${error}" STREQUAL expected)
+    message(NOTICE "${output}${error}")
+    message(SEND_ERROR
+            "${name} printed the above on the ${backend} backend, which "
+            "differs from ${name}.out.")
+  endif()
+endforeach()